@@ -0,0 +1,158 @@
+// Concurrency benchmark for the library interface (bminor2c.h). Every thread
+// translates the given inputs over and over through bminor2c_translate(), and
+// each result is checked against a translation made up front. One JSON object
+// is printed per thread count, with the throughput relative to one thread.
+//
+//   gcc -O2 -DBMINOR2C_NO_MAIN bminor2c.c bench/bminor_api_bench.c -o bminor_api_bench -lm -pthread
+//   ./bminor_api_bench [--threads 1,2,4,8] [--runs N] [-O] input.bminor...
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include "../bminor2c.h"
+
+#define MAX_THREADS 256
+
+typedef struct {
+    char *source;
+    size_t length;
+    uint64_t hash;          // FNV-1a of the C translated up front
+    size_t c_length;
+} Input;
+
+typedef struct {
+    Input *inputs;
+    int input_count;
+    int runs;               // Passes over all inputs per thread
+    Bminor2cOptions options;
+    atomic_int mismatches;
+    atomic_size_t c_bytes;
+} Shared;
+
+// Sink that hashes the C instead of keeping it
+typedef struct {
+    uint64_t hash;
+    size_t length;
+} Digest;
+
+static bool digest_sink(void *context, const char *data, size_t length) {
+    Digest *digest = context;
+    for (size_t i = 0; i < length; i++) {
+        digest->hash ^= (unsigned char)data[i];
+        digest->hash *= 0x100000001b3ULL;
+    }
+    digest->length += length;
+    return true;
+}
+
+static Digest translate_input(const Input *input, const Bminor2cOptions *options) {
+    Digest digest = { 0xcbf29ce484222325ULL, 0 };
+    Bminor2cDiagnostics diagnostics;
+    bminor2c_translate(input->source, input->length, options, digest_sink, &digest, &diagnostics);
+    bminor2c_diagnostics_free(&diagnostics);
+    return digest;
+}
+
+static void *worker(void *arg) {
+    Shared *shared = arg;
+    size_t c_bytes = 0;
+    for (int run = 0; run < shared->runs; run++) {
+        for (int i = 0; i < shared->input_count; i++) {
+            const Input *input = &shared->inputs[i];
+            Digest digest = translate_input(input, &shared->options);
+            if (digest.hash != input->hash || digest.length != input->c_length) atomic_fetch_add(&shared->mismatches, 1);
+            c_bytes += digest.length;
+        }
+    }
+    atomic_fetch_add(&shared->c_bytes, c_bytes);
+    return NULL;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Whole file plus the zero byte bminor2c_translate() expects after it
+static bool read_file(const char *path, Input *input) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+    size_t capacity = 1 << 16, length = 0;
+    char *data = malloc(capacity);
+    size_t n;
+    while (data != NULL && (n = fread(data + length, 1, capacity - length - 1, file)) > 0) {
+        length += n;
+        if (capacity - length < 2) data = realloc(data, capacity *= 2);
+    }
+    fclose(file);
+    if (data == NULL) return false;
+    data[length] = '\0';
+    input->source = data;
+    input->length = length;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const char *thread_list = "1,2,4,8";
+    Shared shared = { 0 };
+    shared.runs = 20;
+    shared.inputs = calloc((size_t)argc, sizeof(Input));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) thread_list = argv[++i];
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) shared.runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-O") == 0) shared.options.optimize = true;
+        else if (argv[i][0] != '-' && read_file(argv[i], &shared.inputs[shared.input_count])) shared.input_count++;
+        else {
+            if (argv[i][0] != '-') perror(argv[i]);
+            fprintf(stderr, "usage: %s [--threads 1,2,4,8] [--runs N] [-O] input.bminor...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (shared.input_count == 0 || shared.runs < 1) {
+        fprintf(stderr, "usage: %s [--threads 1,2,4,8] [--runs N] [-O] input.bminor...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 0; i < shared.input_count; i++) {
+        Digest digest = translate_input(&shared.inputs[i], &shared.options);
+        shared.inputs[i].hash = digest.hash;
+        shared.inputs[i].c_length = digest.length;
+    }
+
+    int status = 0;
+    double base_rate = 0;
+    for (const char *at = thread_list; *at != '\0';) {
+        int threads = atoi(at);
+        if (threads < 1 || threads > MAX_THREADS) threads = 1;
+        pthread_t ids[MAX_THREADS];
+        atomic_store(&shared.mismatches, 0);
+        atomic_store(&shared.c_bytes, 0);
+        double start = now_seconds();
+        for (int t = 1; t < threads; t++) pthread_create(&ids[t], NULL, worker, &shared);
+        worker(&shared);
+        for (int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+        double seconds = now_seconds() - start;
+
+        long translations = (long)threads * shared.runs * shared.input_count;
+        double rate = translations / seconds;
+        if (base_rate == 0) base_rate = rate;
+        int mismatches = atomic_load(&shared.mismatches);
+        if (mismatches > 0) status = 1;
+        printf("{\"threads\": %d, \"translations\": %ld, \"seconds\": %.6f, \"translations_per_sec\": %.1f, "
+               "\"mb_per_sec\": %.2f, \"speedup\": %.2f, \"mismatches\": %d}\n",
+               threads, translations, seconds, rate, atomic_load(&shared.c_bytes) / seconds / 1e6, rate / base_rate,
+               mismatches);
+        fflush(stdout);
+
+        const char *comma = strchr(at, ',');
+        if (comma == NULL) break;
+        at = comma + 1;
+    }
+    for (int i = 0; i < shared.input_count; i++) free(shared.inputs[i].source);
+    free(shared.inputs);
+    return status;
+}
@@ -0,0 +1,379 @@
+// Throughput benchmark for bminor2c. Generates deterministic synthetic Bminor
+// corpora, runs the translator over each one and prints one JSON object per
+// corpus, so results can be appended to a file and compared across releases.
+//
+//   gcc -O2 bench/bminor_bench.c -o bminor_bench
+//   ./bminor_bench [--bminor2c ./bminor2c] [--size MiB] [--runs N] [--seed N]
+//                  [--mix nesting,prints,power,operators,arrays,comments,mixed] [--keep dir]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Deterministic xorshift64* generator, so a seed always gives the same corpus
+typedef struct {
+    uint64_t state;
+} Random;
+
+static uint64_t random_next(Random *random) {
+    random->state ^= random->state >> 12;
+    random->state ^= random->state << 25;
+    random->state ^= random->state >> 27;
+    return random->state * 0x2545f4914f6cdd1dULL;
+}
+
+static int random_below(Random *random, int bound) {
+    return (int)(random_next(random) % (uint64_t)bound);
+}
+
+// Generated text and its line count
+typedef struct {
+    FILE *file;
+    Random random;
+    long bytes;
+    long lines;
+    int functions;
+} Corpus;
+
+static void emit(Corpus *corpus, int indent, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+static void emit(Corpus *corpus, int indent, const char *format, ...) {
+    char line[4096];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) return;
+    if ((size_t)length >= sizeof(line)) length = sizeof(line) - 1;
+    for (int i = 0; i < indent; i++) fputs("    ", corpus->file);
+    fwrite(line, 1, (size_t)length, corpus->file);
+    fputc('\n', corpus->file);
+    corpus->bytes += indent * 4 + length + 1;
+    corpus->lines++;
+}
+
+// if/for nested `depth` levels deep around a few assignments
+static void emit_nested(Corpus *corpus, int indent, int depth) {
+    if (depth == 0) {
+        emit(corpus, indent, "total = total + i%d * %d;", indent % 4, 1 + random_below(&corpus->random, 9));
+        emit(corpus, indent, "count = count + 1;");
+        return;
+    }
+    if (random_below(&corpus->random, 2) == 0) {
+        emit(corpus, indent, "if (total %% %d == %d) {", 2 + depth, random_below(&corpus->random, 2));
+        emit_nested(corpus, indent + 1, depth - 1);
+        emit(corpus, indent, "} else {");
+        emit(corpus, indent + 1, "total = total - %d;", depth);
+        emit(corpus, indent, "}");
+    } else {
+        int variable = indent % 4;
+        emit(corpus, indent, "for (i%d = 0; i%d < %d; i%d++) {", variable, variable, 2 + random_below(&corpus->random, 3),
+             variable);
+        emit_nested(corpus, indent + 1, depth - 1);
+        emit(corpus, indent, "}");
+    }
+}
+
+static void function_nesting(Corpus *corpus) {
+    emit(corpus, 0, "nested_%d: function integer (seed: integer) = {", corpus->functions);
+    emit(corpus, 1, "total: integer = seed;");
+    emit(corpus, 1, "count: integer = 0;");
+    emit(corpus, 1, "i0: integer;");
+    emit(corpus, 1, "i1: integer;");
+    emit(corpus, 1, "i2: integer;");
+    emit(corpus, 1, "i3: integer;");
+    emit_nested(corpus, 1, 8 + random_below(&corpus->random, 8));
+    emit(corpus, 1, "return total + count;");
+    emit(corpus, 0, "}");
+}
+
+// print statements with 10 to 40 arguments of every type
+static void function_prints(Corpus *corpus) {
+    emit(corpus, 0, "report_%d: function void (value: integer, label: string, flag: boolean) = {", corpus->functions);
+    for (int statement = 0; statement < 20; statement++) {
+        char line[4000];
+        int length = snprintf(line, sizeof(line), "print ");
+        int arguments = 10 + random_below(&corpus->random, 31);
+        for (int i = 0; i < arguments && length < (int)sizeof(line) - 64; i++) {
+            const char *separator = i + 1 < arguments ? ", " : ";";
+            switch (random_below(&corpus->random, 5)) {
+            case 0: length += snprintf(line + length, sizeof(line) - length, "\"field %d: \"%s", i, separator); break;
+            case 1: length += snprintf(line + length, sizeof(line) - length, "value%s", separator); break;
+            case 2: length += snprintf(line + length, sizeof(line) - length, "label%s", separator); break;
+            case 3: length += snprintf(line + length, sizeof(line) - length, "flag%s", separator); break;
+            default: length += snprintf(line + length, sizeof(line) - length, "value * %d + %d%s", i, statement, separator); break;
+            }
+        }
+        emit(corpus, 1, "%s", line);
+    }
+    emit(corpus, 0, "}");
+}
+
+// Assignments full of ^ with constant and variable exponents
+static void function_power(Corpus *corpus) {
+    emit(corpus, 0, "power_%d: function integer (a: integer, b: integer, n: integer) = {", corpus->functions);
+    emit(corpus, 1, "x: integer = 0;");
+    for (int statement = 0; statement < 30; statement++) {
+        switch (random_below(&corpus->random, 4)) {
+        case 0: emit(corpus, 1, "x = x + a ^ %d + b ^ %d;", random_below(&corpus->random, 5), 1 + random_below(&corpus->random, 4)); break;
+        case 1: emit(corpus, 1, "x = x - 2 ^ n + (a + b) ^ %d;", 2 + random_below(&corpus->random, 6)); break;
+        case 2: emit(corpus, 1, "x = x + a ^ n * b ^ (n - %d);", 1 + random_below(&corpus->random, 3)); break;
+        default: emit(corpus, 1, "x = x %% 1000 + -a ^ 2 ^ %d;", random_below(&corpus->random, 3)); break;
+        }
+    }
+    emit(corpus, 1, "return x;");
+    emit(corpus, 0, "}");
+}
+
+// A large global array initializer and a function that walks it
+// Thousands of operators in a single expression, a few dozen per line
+static void function_operators(Corpus *corpus) {
+    emit(corpus, 0, "operators_%d: function boolean (a: integer, b: integer, p: boolean, q: boolean) = {", corpus->functions);
+    emit(corpus, 1, "x: integer = a");
+    for (int line = 0; line < 50; line++) {
+        emit(corpus, 2, "^ b ^ 1 ^ a ^ %d ^ (a + b) ^ b ^ 1 ^ a ^ %d ^ (a - b) ^ b ^ 1 ^ a ^ %d ^ b ^ a ^ 1 ^ b ^ a ^ %d",
+             random_below(&corpus->random, 4), random_below(&corpus->random, 4), random_below(&corpus->random, 4),
+             random_below(&corpus->random, 4));
+    }
+    emit(corpus, 2, ";");
+    emit(corpus, 1, "y: boolean = p");
+    for (int line = 0; line < 50; line++) {
+        emit(corpus, 2, "and not q or p and (a < %d or not p) and q or not (b > %d and p) or q and not p and (x == %d or q)",
+             random_below(&corpus->random, 100), random_below(&corpus->random, 100), random_below(&corpus->random, 100));
+    }
+    emit(corpus, 2, ";");
+    emit(corpus, 1, "return y;");
+    emit(corpus, 0, "}");
+}
+
+static void function_arrays(Corpus *corpus) {
+    int size = 500 + random_below(&corpus->random, 1500);
+    emit(corpus, 0, "table_%d: array [%d] integer = {", corpus->functions, size);
+    for (int row = 0; row < size; row += 16) {
+        char line[256];
+        int length = 0;
+        for (int i = row; i < size && i < row + 16; i++) {
+            length += snprintf(line + length, sizeof(line) - length, "%d%s", random_below(&corpus->random, 100000),
+                               i + 1 < size ? ", " : "");
+        }
+        emit(corpus, 1, "%s", line);
+    }
+    emit(corpus, 0, "};");
+    emit(corpus, 0, "sum_%d: function integer () = {", corpus->functions);
+    emit(corpus, 1, "s: integer = 0;");
+    emit(corpus, 1, "for (k: integer = 0; k < %d; k++) {", size);
+    emit(corpus, 2, "s = s + table_%d[k];", corpus->functions);
+    emit(corpus, 1, "}");
+    emit(corpus, 1, "return s;");
+    emit(corpus, 0, "}");
+}
+
+// Mostly comments, with a little code between them
+static void function_comments(Corpus *corpus) {
+    emit(corpus, 0, "/* Block comment %d", corpus->functions);
+    for (int i = 0; i < 10 + random_below(&corpus->random, 20); i++) {
+        emit(corpus, 0, "   describing step %d of the algorithm in some detail, with symbols like { } ; ^ \"", i);
+    }
+    emit(corpus, 0, "*/");
+    emit(corpus, 0, "commented_%d: function integer (v: integer) = {", corpus->functions);
+    for (int i = 0; i < 15; i++) {
+        emit(corpus, 1, "// Line comment %d explains the next statement at length so that comments dominate", i);
+        emit(corpus, 1, "v = v + %d; // trailing remark", i);
+    }
+    emit(corpus, 1, "return v;");
+    emit(corpus, 0, "}");
+}
+
+typedef void (*FunctionGenerator)(Corpus *corpus);
+
+typedef struct {
+    const char *name;
+    FunctionGenerator generator;    // NULL: round-robin over all the others
+} Mix;
+
+static const Mix mixes[] = {
+    { "nesting", function_nesting },
+    { "prints", function_prints },
+    { "power", function_power },
+    { "operators", function_operators },
+    { "arrays", function_arrays },
+    { "comments", function_comments },
+    { "mixed", NULL },
+};
+
+#define MIX_COUNT (sizeof(mixes) / sizeof(mixes[0]))
+
+// Write a corpus of about `target` bytes ending in a main function
+static bool generate(const Mix *mix, const char *path, long target, uint64_t seed, long *bytes, long *lines) {
+    Corpus corpus = { fopen(path, "w"), { seed * 0x9e3779b97f4a7c15ULL + 1 }, 0, 0, 0 };
+    if (corpus.file == NULL) return false;
+    emit(&corpus, 0, "// Synthetic %s corpus, seed %llu", mix->name, (unsigned long long)seed);
+    emit(&corpus, 0, "%s", "");
+    while (corpus.bytes < target) {
+        FunctionGenerator generator = mix->generator;
+        if (generator == NULL) generator = mixes[corpus.functions % (MIX_COUNT - 1)].generator;
+        generator(&corpus);
+        emit(&corpus, 0, "%s", "");
+        corpus.functions++;
+    }
+    emit(&corpus, 0, "main: function integer () = {");
+    emit(&corpus, 1, "print \"%d functions\\n\";", corpus.functions);
+    emit(&corpus, 1, "return 0;");
+    emit(&corpus, 0, "}");
+    bool ok = fclose(corpus.file) == 0;
+    struct stat st;
+    *bytes = stat(path, &st) == 0 ? (long)st.st_size : corpus.bytes;
+    *lines = corpus.lines;
+    return ok;
+}
+
+// One translator run
+typedef struct {
+    double seconds;
+    long peak_rss_kib;
+    size_t arena_allocations;
+    size_t arena_blocks;
+    size_t arena_bytes;
+} Run;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Run `bminor2c --memory-stats input > /dev/null`, timing it and reading
+// its arena statistics from standard error
+static bool run_translator(const char *bminor2c, const char *input, Run *run) {
+    int messages[2];
+    if (pipe(messages) != 0) return false;
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(messages[1], STDERR_FILENO);
+        close(messages[0]);
+        execl(bminor2c, bminor2c, "--memory-stats", input, (char *)NULL);
+        _exit(127);
+    }
+    close(messages[1]);
+    char text[8192];
+    size_t length = 0;
+    ssize_t n;
+    while ((n = read(messages[0], text + length, sizeof(text) - 1 - length)) > 0) length += (size_t)n;
+    text[length] = '\0';
+    close(messages[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) return false;
+    run->seconds = now_seconds() - start;
+    run->peak_rss_kib = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "bminor_bench: %s failed on %s\n%s", bminor2c, input, text);
+        return false;
+    }
+    const char *arena = strstr(text, "arena: ");
+    run->arena_allocations = run->arena_blocks = run->arena_bytes = 0;
+    if (arena != NULL) {
+        sscanf(arena, "arena: %zu allocations in %zu blocks, %zu bytes used", &run->arena_allocations,
+               &run->arena_blocks, &run->arena_bytes);
+    }
+    return true;
+}
+
+static bool mix_selected(const char *list, const char *name) {
+    if (list == NULL) return true;
+    size_t length = strlen(name);
+    for (const char *at = list; *at != '\0';) {
+        const char *comma = strchr(at, ',');
+        size_t item = comma != NULL ? (size_t)(comma - at) : strlen(at);
+        if (item == length && strncmp(at, name, length) == 0) return true;
+        if (comma == NULL) break;
+        at = comma + 1;
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    const char *bminor2c = "./bminor2c";
+    const char *selected = NULL;
+    const char *keep_dir = NULL;
+    double size_mib = 8;
+    int runs = 3;
+    uint64_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bminor2c") == 0 && i + 1 < argc) bminor2c = argv[++i];
+        else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) size_mib = atof(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc) selected = argv[++i];
+        else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) keep_dir = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--bminor2c path] [--size MiB] [--runs N] [--seed N] [--mix a,b,...] [--keep dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    char temp_dir[] = "/tmp/bminor_bench.XXXXXX";
+    const char *dir = keep_dir;
+    if (dir == NULL) {
+        if (mkdtemp(temp_dir) == NULL) {
+            perror("bminor_bench: mkdtemp");
+            return 1;
+        }
+        dir = temp_dir;
+    } else if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+
+    int status = 0;
+    for (size_t m = 0; m < MIX_COUNT; m++) {
+        const Mix *mix = &mixes[m];
+        if (!mix_selected(selected, mix->name)) continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.bminor", dir, mix->name);
+        long bytes, lines;
+        if (!generate(mix, path, (long)(size_mib * 1024 * 1024), seed, &bytes, &lines)) {
+            perror(path);
+            status = 1;
+            continue;
+        }
+
+        // Best of `runs` for time; memory figures do not vary between runs
+        Run best = { 0 };
+        bool ok = true;
+        for (int r = 0; r < runs && ok; r++) {
+            Run run;
+            ok = run_translator(bminor2c, path, &run);
+            if (ok && (r == 0 || run.seconds < best.seconds)) best = run;
+        }
+        if (keep_dir == NULL) unlink(path);
+        if (!ok) {
+            status = 1;
+            continue;
+        }
+        printf("{\"corpus\": \"%s\", \"seed\": %llu, \"bytes\": %ld, \"lines\": %ld, \"runs\": %d, "
+               "\"seconds\": %.6f, \"lines_per_sec\": %.0f, \"mb_per_sec\": %.2f, \"peak_rss_kib\": %ld, "
+               "\"arena_allocations\": %zu, \"arena_blocks\": %zu, \"arena_bytes\": %zu}\n",
+               mix->name, (unsigned long long)seed, bytes, lines, runs, best.seconds, lines / best.seconds,
+               bytes / best.seconds / 1e6, best.peak_rss_kib, best.arena_allocations, best.arena_blocks, best.arena_bytes);
+        fflush(stdout);
+    }
+    if (keep_dir == NULL) rmdir(temp_dir);
+    return status;
+}
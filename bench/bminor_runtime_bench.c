@@ -0,0 +1,186 @@
+// Runtime benchmark for the generated C. Each kernel in bench/kernels is
+// translated with bminor2c, and both the result and the kernel's hand-written
+// C baseline are compiled at -O2 and run. One JSON object per kernel gives
+// both times and the slowdown of the translated program, and records whether
+// the two printed the same output.
+//
+//   gcc -O2 bench/bminor_runtime_bench.c -o bminor_runtime_bench
+//   ./bminor_runtime_bench [--bminor2c ./bminor2c] [--cc cc] [--kernels bench/kernels] [--runs N]
+//                          [--kernel power,arrays,branches,prints,calls,exponents,effects,folding,escapes] [--flag -O] [--keep dir]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static const char *const kernels[] = { "power", "arrays", "branches", "prints", "calls", "exponents", "effects", "folding", "escapes" };
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+// Most bminor2c options passed on with --flag
+#define MAX_FLAGS 8
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Run a command with its standard output going to `output_path`, and time it.
+// False if it could not be started or did not exit with status 0.
+static bool run_command(char *const argv[], const char *output_path, double *seconds) {
+    double start = now_seconds();
+    pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) _exit(127);
+        dup2(fd, STDOUT_FILENO);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0) return false;
+    if (seconds != NULL) *seconds = now_seconds() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "bminor_runtime_bench: %s failed\n", argv[0]);
+        return false;
+    }
+    return true;
+}
+
+static bool compile(const char *cc, const char *source, const char *executable) {
+    char *argv[] = { (char *)cc, "-O2", "-w", (char *)source, "-o", (char *)executable, "-lm", NULL };
+    return run_command(argv, "/dev/null", NULL);
+}
+
+// Best of `runs` runs of an executable
+static bool time_program(const char *executable, const char *output_path, int runs, double *best) {
+    char *argv[] = { (char *)executable, NULL };
+    for (int r = 0; r < runs; r++) {
+        double seconds;
+        if (!run_command(argv, output_path, &seconds)) return false;
+        if (r == 0 || seconds < *best) *best = seconds;
+    }
+    return true;
+}
+
+static bool same_contents(const char *path_a, const char *path_b) {
+    FILE *a = fopen(path_a, "rb");
+    FILE *b = fopen(path_b, "rb");
+    bool same = a != NULL && b != NULL;
+    while (same) {
+        int ca = getc(a), cb = getc(b);
+        same = ca == cb;
+        if (ca == EOF) break;
+    }
+    if (a != NULL) fclose(a);
+    if (b != NULL) fclose(b);
+    return same;
+}
+
+static bool kernel_selected(const char *list, const char *name) {
+    if (list == NULL) return true;
+    size_t length = strlen(name);
+    for (const char *at = list; *at != '\0';) {
+        const char *comma = strchr(at, ',');
+        size_t item = comma != NULL ? (size_t)(comma - at) : strlen(at);
+        if (item == length && strncmp(at, name, length) == 0) return true;
+        if (comma == NULL) break;
+        at = comma + 1;
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    const char *bminor2c = "./bminor2c";
+    const char *cc = "cc";
+    const char *kernel_dir = "bench/kernels";
+    const char *selected = NULL;
+    const char *keep_dir = NULL;
+    char *flags[MAX_FLAGS];
+    int flag_count = 0;
+    int runs = 3;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bminor2c") == 0 && i + 1 < argc) bminor2c = argv[++i];
+        else if (strcmp(argv[i], "--cc") == 0 && i + 1 < argc) cc = argv[++i];
+        else if (strcmp(argv[i], "--kernels") == 0 && i + 1 < argc) kernel_dir = argv[++i];
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) selected = argv[++i];
+        else if (strcmp(argv[i], "--flag") == 0 && i + 1 < argc && flag_count < MAX_FLAGS) flags[flag_count++] = argv[++i];
+        else if (strcmp(argv[i], "--keep") == 0 && i + 1 < argc) keep_dir = argv[++i];
+        else {
+            fprintf(stderr,
+                    "usage: %s [--bminor2c path] [--cc compiler] [--kernels dir] [--runs N] [--kernel a,b,...] "
+                    "[--flag option] [--keep dir]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1) runs = 1;
+
+    char temp_dir[] = "/tmp/bminor_runtime_bench.XXXXXX";
+    const char *dir = keep_dir;
+    if (dir == NULL) {
+        if (mkdtemp(temp_dir) == NULL) {
+            perror("bminor_runtime_bench: mkdtemp");
+            return 1;
+        }
+        dir = temp_dir;
+    } else if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        perror(dir);
+        return 1;
+    }
+
+    int status = 0;
+    for (size_t k = 0; k < KERNEL_COUNT; k++) {
+        const char *name = kernels[k];
+        if (!kernel_selected(selected, name)) continue;
+        char input[4096], baseline[4096], generated[4096], program[4096], baseline_program[4096];
+        char output[4096], baseline_output[4096];
+        snprintf(input, sizeof(input), "%s/%s.bminor", kernel_dir, name);
+        snprintf(baseline, sizeof(baseline), "%s/%s.c", kernel_dir, name);
+        snprintf(generated, sizeof(generated), "%s/%s.c", dir, name);
+        snprintf(program, sizeof(program), "%s/%s", dir, name);
+        snprintf(baseline_program, sizeof(baseline_program), "%s/%s_baseline", dir, name);
+        snprintf(output, sizeof(output), "%s/%s.out", dir, name);
+        snprintf(baseline_output, sizeof(baseline_output), "%s/%s_baseline.out", dir, name);
+
+        char *translate[MAX_FLAGS + 3];
+        int count = 0;
+        translate[count++] = (char *)bminor2c;
+        for (int f = 0; f < flag_count; f++) translate[count++] = flags[f];
+        translate[count++] = input;
+        translate[count] = NULL;
+
+        double seconds = 0, baseline_seconds = 0;
+        bool ok = run_command(translate, generated, NULL) && compile(cc, generated, program) &&
+                  compile(cc, baseline, baseline_program) && time_program(program, output, runs, &seconds) &&
+                  time_program(baseline_program, baseline_output, runs, &baseline_seconds);
+        if (!ok) {
+            fprintf(stderr, "bminor_runtime_bench: %s: could not build or run\n", name);
+            status = 1;
+            continue;
+        }
+        bool matches = same_contents(output, baseline_output);
+        if (!matches) status = 1;
+        printf("{\"kernel\": \"%s\", \"runs\": %d, \"seconds\": %.6f, \"baseline_seconds\": %.6f, "
+               "\"slowdown\": %.3f, \"output_matches\": %s}\n",
+               name, runs, seconds, baseline_seconds, seconds / baseline_seconds, matches ? "true" : "false");
+        fflush(stdout);
+        if (keep_dir == NULL) {
+            unlink(generated);
+            unlink(program);
+            unlink(baseline_program);
+            unlink(output);
+            unlink(baseline_output);
+        }
+    }
+    if (keep_dir == NULL) rmdir(temp_dir);
+    return status;
+}
@@ -0,0 +1,22 @@
+// Hand-written baseline for arrays.bminor
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(void) {
+    int n = 1000000;
+    int *a = malloc(n * sizeof(int));
+    int total = 0, largest = 0, evens = 0;
+    for (int pass = 0; pass < 100; pass++) {
+        for (int i = 0; i < n; i++) a[i] = (i * 7 + pass) % 1000;
+        int sum = 0;
+        for (int i = 0; i < n; i++) sum += a[i];
+        for (int i = 0; i < n; i++) {
+            if (a[i] > largest) largest = a[i];
+            if (a[i] % 2 == 0) evens++;
+        }
+        total = (total + sum) % 1000003;
+    }
+    printf("%d %d %d\n", total, largest, evens);
+    free(a);
+    return 0;
+}
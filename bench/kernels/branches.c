@@ -0,0 +1,28 @@
+// Hand-written baseline for branches.bminor
+#include <stdio.h>
+
+int main(void) {
+    int seed = 1, a = 0, b = 0, c = 0;
+    for (int i = 0; i < 20000000; i++) {
+        seed = (seed * 75 + 74) % 65537;
+        int x = seed % 1000;
+        if (x < 250) {
+            if (x % 2 == 0) a += 1;
+            else b += 3;
+        } else if (x < 500) {
+            switch (x % 3) {
+            case 0: a += 2; break;
+            case 1: b += 1; break;
+            default: c += 1; break;
+            }
+        } else if (x < 750) {
+            if (x > 600 && x % 5 != 0) c += 2;
+            else a += 1;
+        } else {
+            if (x % 7 != 0 || x > 900) b += 2;
+            else c += 3;
+        }
+    }
+    printf("%d %d %d\n", a, b, c);
+    return 0;
+}
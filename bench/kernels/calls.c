@@ -0,0 +1,26 @@
+// Hand-written baseline for calls.bminor
+#include <stdio.h>
+
+static int fib(int n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+static int gcd(int a, int b) {
+    while (b != 0) {
+        int r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+static int clamp(int x, int low, int high) {
+    return x < low ? low : x > high ? high : x;
+}
+
+int main(void) {
+    int total = fib(34);
+    for (int i = 1; i < 20000000; i++) total = (total + gcd(i, 360) + clamp(i % 100, 10, 90)) % 1000003;
+    printf("%d\n", total);
+    return 0;
+}
@@ -0,0 +1,21 @@
+// Hand-written baseline for effects.bminor
+#include <stdio.h>
+
+static int count = 0;
+
+static int tick(void) {
+    count++;
+    printf("[tick %d]", count);
+    return count;
+}
+
+int main(void) {
+    for (int i = 0; i < 300000; i++) {
+        int first = tick();
+        printf("first %d\n", first);
+        int second = tick();
+        printf("second %d\n", second);
+        printf("count %d\n", count);
+    }
+    return 0;
+}
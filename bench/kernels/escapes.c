@@ -0,0 +1,21 @@
+// Hand-written baseline for escapes.bminor
+#include <stdio.h>
+
+int main(void) {
+    for (int i = 0; i < 200000; i++) {
+        putchar(1);
+        putchar('1');
+        putchar(4);
+        putchar('2');
+        putchar('\n');
+        putchar('7');
+        fputs("A2", stdout);
+        putchar(7);
+        printf("false%d\n", i % 10);
+        putchar(1);
+        putchar('2');
+        putchar(4);
+        fputs("1ac\n", stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+// Hand-written baseline for exponents.bminor
+#include <stdio.h>
+
+// Bminor's ^ on 32-bit integers: wraps around, and a negative exponent
+// leaves only 1 and -1 nonzero
+static int power(int base, int exponent) {
+    if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;
+    unsigned result = 1, factor = (unsigned)base;
+    for (; exponent > 0; exponent >>= 1) {
+        if (exponent & 1) result *= factor;
+        factor *= factor;
+    }
+    return (int)result;
+}
+
+int main(void) {
+    int total = 0;
+    for (int i = 0; i < 20000000; i++) {
+        int r = i % 7 - 3;
+        int inverse = r == 1 ? 1 : r == -1 ? -1 : 0;
+        int inverse_square = r == 1 || r == -1 ? 1 : 0;
+        int shift = i % 40 <= 30 ? (1 << (i % 40)) % 1000 : i % 40 == 31 ? power(2, 31) % 1000 : 0;
+        total = (total + inverse + inverse_square + 1 + r + shift + power(r + 5, 33) % 1000) % 1000003;
+    }
+    printf("%d %d %d %d %d\n", total, 0, power(3, 40), 0, -1);
+    return 0;
+}
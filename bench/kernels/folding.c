@@ -0,0 +1,16 @@
+// Hand-written baseline for folding.bminor
+#include <stdio.h>
+
+static int a[1000];
+
+int main(void) {
+    int total = 0;
+    for (int pass = 0; pass < 20000; pass++) {
+        for (int i = 0; i < 1000; i++) {
+            a[i] = i + pass;
+            total = (total + a[i]) % 1000003;
+        }
+    }
+    printf("%d\n", total);
+    return 0;
+}
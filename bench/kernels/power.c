@@ -0,0 +1,14 @@
+// Hand-written baseline for power.bminor
+#include <stdio.h>
+
+int main(void) {
+    int total = 0;
+    for (int i = 0; i < 30000000; i++) {
+        int r = i % 13;
+        int p = 1;
+        for (int k = i % 5; k > 0; k--) p *= r + 1;
+        total = (total + r * r + r * r * r + (1 << (i % 16)) + p) % 1000003;
+    }
+    printf("%d\n", total);
+    return 0;
+}
@@ -0,0 +1,7 @@
+// Hand-written baseline for prints.bminor
+#include <stdio.h>
+
+int main(void) {
+    for (int i = 0; i < 3000000; i++) printf("item %d: %d x of 3000000\n", i, i % 7);
+    return 0;
+}
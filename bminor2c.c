@@ -4,566 +4,6107 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <math.h> // Required for pow() function
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "bminor2c.h"
 
-// Helper function to trim leading and trailing whitespace from a string
-void trim(char *str) {
-    if (str == NULL) return;
-
-    char *start = str;
-    while (isspace((unsigned char)*start)) start++;
-
-    char *end = start + strlen(start) - 1;
-    while (end >= start && isspace((unsigned char)*end)) end--;
-    *(end + 1) = '\0';
-
-    memmove(str, start, end - start + 2);
-}
-
-// Function to convert Bminor power operator (^) to C's pow()
-// This version attempts to handle multiple power operators on one line
-// and rebuilds the string more carefully.
-void convert_power(char *expr) {
-    char temp_buffer[512];
-    temp_buffer[0] = '\0';
-    char *current_pos = expr; // Current reading position in the original expr
-
-    char *power_op_pos;
-    while ((power_op_pos = strchr(current_pos, '^')) != NULL) {
-        // Find end of base (going backward from '^')
-        char *base_end = power_op_pos - 1;
-        while (base_end >= expr && isspace((unsigned char)*base_end)) base_end--;
-
-        // Find start of the base: go backwards until non-expression character or start of string
-        char *base_start = base_end;
-        int paren_balance = 0;
-        while (base_start >= expr) {
-            char c = *base_start;
-            if (c == ')') paren_balance++;
-            else if (c == '(') paren_balance--;
-
-            // Allow alphanumeric, underscore, dot, operators within balanced parentheses
-            if (isalnum((unsigned char)c) || c == '_' || c == '.' || c == '(' || c == ')' || c == '-' || c == '+' || paren_balance > 0) {
-                base_start--;
-            } else { // Found non-expression character or unbalanced parenthesis
+#ifdef BMINOR2C_NO_MAIN
+// Built as a library: what only the command line uses goes unreferenced
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+
+// Output is accumulated here and handed to write() in large chunks
+#define OUTPUT_FLUSH_THRESHOLD (1 << 20)
+
+// A buffer starts this small, so that many short translations at once do
+// not each map and unmap a large block, and grows as far as it needs to
+#define OUTPUT_INITIAL_CAPACITY (64 * 1024)
+
+// Whole input file, either mapped or bulk-read. The byte after the contents
+// is always readable and zero.
+typedef struct {
+    char *data;
+    size_t length;
+    size_t mapped_length; // Non-zero when data came from mmap()
+} InputBuffer;
+
+// Growable output sink that replaces the per-statement printf() calls
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    int fd;
+    int error;      // errno of a failed write(); later output is discarded
+    size_t flushed; // Bytes handed to write() so far
+    bool timed;     // --stats: add the time spent in write() to write_seconds
+    double write_seconds;
+    Bminor2cSink sink;  // Takes the output instead of fd when set
+    void *sink_context;
+} OutputBuffer;
+
+// Bulk-read everything from fd into a malloc'd buffer (used for pipes and
+// files that cannot be mapped with a zero byte after the contents)
+static bool read_all(int fd, InputBuffer *in, size_t size_hint) {
+    size_t capacity = size_hint > 0 ? size_hint + 1 : 1 << 16;
+    size_t length = 0;
+    char *data = malloc(capacity);
+    if (data == NULL) return false;
+
+    for (;;) {
+        if (capacity - length < 2) {
+            char *grown = realloc(data, capacity * 2);
+            if (grown == NULL) { free(data); return false; }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + length, capacity - length - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            free(data);
+            return false;
+        }
+        if (n == 0) break;
+        length += (size_t)n;
+    }
+    data[length] = '\0';
+    in->data = data;
+    in->length = length;
+    in->mapped_length = 0;
+    return true;
+}
+
+// Load the whole input. Regular files are mapped read-only; everything else
+// is bulk-read.
+static bool load_input(int fd, InputBuffer *in) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = (size_t)st.st_size;
+        long page_size = sysconf(_SC_PAGESIZE);
+        // The tail of the last page is zero-filled, which provides the
+        // terminating NUL; a file that exactly fills its pages has no room.
+        if (page_size > 0 && size % (size_t)page_size != 0) {
+            void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, size, MADV_SEQUENTIAL);
+                in->data = map;
+                in->length = size;
+                in->mapped_length = size;
+                return true;
+            }
+        }
+        return read_all(fd, in, size);
+    }
+    return read_all(fd, in, 0);
+}
+
+static void release_input(InputBuffer *in) {
+    if (in->mapped_length > 0) munmap(in->data, in->mapped_length);
+    else free(in->data);
+    in->data = NULL;
+    in->length = in->mapped_length = 0;
+}
+
+static double now_seconds(void);
+
+// A buffer without a file descriptor or sink only collects
+static void output_flush(OutputBuffer *out) {
+    if (out->sink != NULL) {
+        if (out->error == 0 && out->length > 0 && !out->sink(out->sink_context, out->data, out->length)) {
+            out->error = ECANCELED;
+        }
+        out->flushed += out->length;
+        out->length = 0;
+        return;
+    }
+    if (out->fd < 0) return;
+    double start = out->timed ? now_seconds() : 0;
+    size_t written = 0;
+    while (written < out->length && out->error == 0) {
+        ssize_t n = write(out->fd, out->data + written, out->length - written);
+        if (n < 0) {
+            if (errno != EINTR) out->error = errno;
+            continue;
+        }
+        written += (size_t)n;
+    }
+    out->flushed += out->length;
+    out->length = 0;
+    if (out->timed) out->write_seconds += now_seconds() - start;
+}
+
+static void output_reserve(OutputBuffer *out, size_t extra) {
+    if (out->length + extra <= out->capacity) return;
+    size_t capacity = out->capacity > 0 ? out->capacity : OUTPUT_INITIAL_CAPACITY;
+    while (capacity < out->length + extra) capacity *= 2;
+    char *grown = realloc(out->data, capacity);
+    if (grown == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
+    out->data = grown;
+    out->capacity = capacity;
+}
+
+static void output_maybe_flush(OutputBuffer *out) {
+    if (out->length >= OUTPUT_FLUSH_THRESHOLD) output_flush(out);
+}
+
+static void output_write(OutputBuffer *out, const char *text, size_t length) {
+    output_reserve(out, length);
+    memcpy(out->data + out->length, text, length);
+    out->length += length;
+    output_maybe_flush(out);
+}
+
+static void output_puts(OutputBuffer *out, const char *text) {
+    output_write(out, text, strlen(text));
+}
+
+static void output_printf(OutputBuffer *out, const char *format, ...) {
+    output_reserve(out, 256);
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n >= out->capacity - out->length) {
+        output_reserve(out, (size_t)n + 1);
+        va_start(args, format);
+        vsnprintf(out->data + out->length, out->capacity - out->length, format, args);
+        va_end(args);
+    }
+    out->length += (size_t)n;
+    output_maybe_flush(out);
+}
+
+static void output_line(OutputBuffer *out, const char *text, size_t length) {
+    output_reserve(out, length + 1);
+    memcpy(out->data + out->length, text, length);
+    out->data[out->length + length] = '\n';
+    out->length += length + 1;
+    output_maybe_flush(out);
+}
+
+static void output_indent(OutputBuffer *out, int level) {
+    for (int i = 0; i < level; i++) output_write(out, "    ", 4);
+}
+
+// Messages about one input. In batch mode they are collected per file and
+// written with a single write(), so reports from parallel jobs stay whole.
+typedef struct {
+    const char *path;   // Name of the input, or NULL when there is only one
+    OutputBuffer *out;
+    int count;
+} Diagnostics;
+
+static void diagnose(Diagnostics *diagnostics, int line, const char *format, ...) {
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (diagnostics->path != NULL) output_printf(diagnostics->out, "bminor2c: %s:%d: %s\n", diagnostics->path, line, message);
+    else output_printf(diagnostics->out, "bminor2c: line %d: %s\n", line, message);
+    diagnostics->count++;
+}
+
+// Token kinds produced by the lexer
+typedef enum {
+    TOKEN_EOF,
+    TOKEN_ERROR,
+    TOKEN_IDENTIFIER,
+    TOKEN_NUMBER,
+    TOKEN_STRING_LITERAL,
+    TOKEN_CHAR_LITERAL,
+    TOKEN_LINE_COMMENT,
+    TOKEN_BLOCK_COMMENT,
+
+    // Keywords
+    TOKEN_AND,
+    TOKEN_ARRAY,
+    TOKEN_BOOLEAN,
+    TOKEN_CHAR,
+    TOKEN_ELSE,
+    TOKEN_FALSE,
+    TOKEN_FOR,
+    TOKEN_FUNCTION,
+    TOKEN_IF,
+    TOKEN_INTEGER,
+    TOKEN_NEW,
+    TOKEN_NOT,
+    TOKEN_OR,
+    TOKEN_PRINT,
+    TOKEN_RETURN,
+    TOKEN_STRING,
+    TOKEN_TRUE,
+    TOKEN_VOID,
+
+    // Punctuation and operators
+    TOKEN_LEFT_PAREN,
+    TOKEN_RIGHT_PAREN,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
+    TOKEN_LEFT_BRACE,
+    TOKEN_RIGHT_BRACE,
+    TOKEN_COMMA,
+    TOKEN_SEMICOLON,
+    TOKEN_COLON,
+    TOKEN_ASSIGN,
+    TOKEN_EQUAL,
+    TOKEN_NOT_EQUAL,
+    TOKEN_LESS,
+    TOKEN_LESS_EQUAL,
+    TOKEN_GREATER,
+    TOKEN_GREATER_EQUAL,
+    TOKEN_PLUS,
+    TOKEN_MINUS,
+    TOKEN_STAR,
+    TOKEN_SLASH,
+    TOKEN_PERCENT,
+    TOKEN_CARET,
+    TOKEN_INCREMENT,
+    TOKEN_DECREMENT,
+    TOKEN_BANG,
+    TOKEN_AMP_AMP,
+    TOKEN_PIPE_PIPE
+} TokenKind;
+
+// A token is a span of the input buffer; nothing is copied
+typedef struct {
+    TokenKind kind;
+    int line;               // 1-based line of the first character
+    const char *line_start; // Start of that line, for verbatim re-emission
+    const char *start;
+    size_t length;
+} Token;
+
+typedef struct {
+    const char *cursor;
+    const char *end;
+    const char *line_start;
+    int line;
+} Lexer;
+
+static void lexer_init(Lexer *lexer, const char *source, size_t length) {
+    lexer->cursor = source;
+    lexer->end = source + length;
+    lexer->line_start = source;
+    lexer->line = 1;
+}
+
+// Account for every newline in [start, end) that the lexer has moved past
+static void lexer_count_lines(Lexer *lexer, const char *start, const char *end) {
+    const char *p = start;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), newline));
+        if (mask != 0) {
+            lexer->line += __builtin_popcount(mask);
+            lexer->line_start = p + (31 - __builtin_clz(mask)) + 1;
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            lexer->line++;
+            lexer->line_start = p + 1;
+        }
+    }
+}
+
+// Skip blanks and newlines. Runs of indentation are consumed 16 bytes at a
+// time when SSE2 is available.
+static void lexer_skip_whitespace(Lexer *lexer) {
+    const char *p = lexer->cursor;
+    const char *end = lexer->end;
+#if defined(__SSE2__)
+    if (end - p >= 16 && isspace((unsigned char)*p)) {
+        const __m128i space = _mm_set1_epi8(' ');
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i carriage_return = _mm_set1_epi8('\r');
+        const __m128i newline = _mm_set1_epi8('\n');
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            __m128i newlines = _mm_cmpeq_epi8(chunk, newline);
+            __m128i blanks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                          _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return), newlines));
+            unsigned other = ~(unsigned)_mm_movemask_epi8(blanks) & 0xFFFFu;
+            unsigned newline_mask = (unsigned)_mm_movemask_epi8(newlines);
+            unsigned run = other != 0 ? (unsigned)__builtin_ctz(other) : 16;
+            if (run < 16) newline_mask &= (1u << run) - 1;
+            if (newline_mask != 0) {
+                lexer->line += __builtin_popcount(newline_mask);
+                lexer->line_start = p + (31 - __builtin_clz(newline_mask)) + 1;
+            }
+            p += run;
+            if (run < 16) {
+                lexer->cursor = p;
+                return;
+            }
+        }
+    }
+#endif
+    while (p < end && isspace((unsigned char)*p)) {
+        if (*p == '\n') {
+            lexer->line++;
+            lexer->line_start = p + 1;
+        }
+        p++;
+    }
+    lexer->cursor = p;
+}
+
+// Find the closing quote of a string or character literal starting after the
+// opening quote. Returns the position of the closing quote, or of the newline
+// or end of input for an unterminated literal.
+static const char *find_literal_end(const char *p, const char *end, char quote) {
+#if defined(__SSE2__)
+    const __m128i quote_vector = _mm_set1_epi8(quote);
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i newline = _mm_set1_epi8('\n');
+#endif
+    for (;;) {
+#if defined(__SSE2__)
+        while (end - p >= 16) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+            __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote_vector),
+                                        _mm_or_si128(_mm_cmpeq_epi8(chunk, backslash), _mm_cmpeq_epi8(chunk, newline)));
+            unsigned mask = (unsigned)_mm_movemask_epi8(hits);
+            if (mask != 0) {
+                p += __builtin_ctz(mask);
+                break;
+            }
+            p += 16;
+        }
+#endif
+        while (p < end && *p != quote && *p != '\\' && *p != '\n') p++;
+        if (p < end && *p == '\\') {
+            p += (end - p >= 2) ? 2 : 1; // Skip the escaped character
+            continue;
+        }
+        return p;
+    }
+}
+
+// Map an identifier to its keyword kind, if it is one
+static TokenKind keyword_kind(const char *text, size_t length) {
+#define KEYWORD(word, kind) if (length == sizeof(word) - 1 && memcmp(text, word, length) == 0) return kind
+    switch (text[0]) {
+    case 'a': KEYWORD("and", TOKEN_AND); KEYWORD("array", TOKEN_ARRAY); break;
+    case 'b': KEYWORD("boolean", TOKEN_BOOLEAN); break;
+    case 'c': KEYWORD("char", TOKEN_CHAR); break;
+    case 'e': KEYWORD("else", TOKEN_ELSE); break;
+    case 'f': KEYWORD("false", TOKEN_FALSE); KEYWORD("for", TOKEN_FOR); KEYWORD("function", TOKEN_FUNCTION); break;
+    case 'i': KEYWORD("if", TOKEN_IF); KEYWORD("integer", TOKEN_INTEGER); break;
+    case 'n': KEYWORD("new", TOKEN_NEW); KEYWORD("not", TOKEN_NOT); break;
+    case 'o': KEYWORD("or", TOKEN_OR); break;
+    case 'p': KEYWORD("print", TOKEN_PRINT); break;
+    case 'r': KEYWORD("return", TOKEN_RETURN); break;
+    case 's': KEYWORD("string", TOKEN_STRING); break;
+    case 't': KEYWORD("true", TOKEN_TRUE); break;
+    case 'v': KEYWORD("void", TOKEN_VOID); break;
+    default: break;
+    }
+#undef KEYWORD
+    return TOKEN_IDENTIFIER;
+}
+
+static bool is_identifier_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Produce the next token in a single forward pass over the input
+static void lexer_next(Lexer *lexer, Token *token) {
+    lexer_skip_whitespace(lexer);
+
+    const char *p = lexer->cursor;
+    const char *end = lexer->end;
+    token->line = lexer->line;
+    token->line_start = lexer->line_start;
+    token->start = p;
+
+    if (p >= end) {
+        token->kind = TOKEN_EOF;
+        token->length = 0;
+        return;
+    }
+
+    char c = *p;
+    TokenKind kind = TOKEN_ERROR;
+    const char *next = p + 1;
+    char following = (end - p >= 2) ? p[1] : '\0';
+
+    if (isalpha((unsigned char)c) || c == '_') {
+        while (next < end && is_identifier_char(*next)) next++;
+        kind = keyword_kind(p, (size_t)(next - p));
+    } else if (isdigit((unsigned char)c)) {
+        while (next < end && (isdigit((unsigned char)*next) || *next == '.')) next++;
+        kind = TOKEN_NUMBER;
+    } else if (c == '"' || c == '\'') {
+        next = find_literal_end(p + 1, end, c);
+        if (next < end && *next == c) next++;
+        kind = (c == '"') ? TOKEN_STRING_LITERAL : TOKEN_CHAR_LITERAL;
+    } else if (c == '/' && following == '/') {
+        next = memchr(p, '\n', (size_t)(end - p));
+        if (next == NULL) next = end;
+        while (next > p && next[-1] == '\r') next--;
+        kind = TOKEN_LINE_COMMENT;
+    } else if (c == '/' && following == '*') {
+        const char *close = p + 2;
+        for (;;) {
+            close = memchr(close, '*', (size_t)(end - close));
+            if (close == NULL) { next = end; break; }
+            if (close + 1 < end && close[1] == '/') { next = close + 2; break; }
+            close++;
+        }
+        kind = TOKEN_BLOCK_COMMENT;
+    } else {
+        switch (c) {
+        case '(': kind = TOKEN_LEFT_PAREN; break;
+        case ')': kind = TOKEN_RIGHT_PAREN; break;
+        case '[': kind = TOKEN_LEFT_BRACKET; break;
+        case ']': kind = TOKEN_RIGHT_BRACKET; break;
+        case '{': kind = TOKEN_LEFT_BRACE; break;
+        case '}': kind = TOKEN_RIGHT_BRACE; break;
+        case ',': kind = TOKEN_COMMA; break;
+        case ';': kind = TOKEN_SEMICOLON; break;
+        case ':': kind = TOKEN_COLON; break;
+        case '*': kind = TOKEN_STAR; break;
+        case '/': kind = TOKEN_SLASH; break;
+        case '%': kind = TOKEN_PERCENT; break;
+        case '^': kind = TOKEN_CARET; break;
+        case '=':
+            if (following == '=') { kind = TOKEN_EQUAL; next++; } else kind = TOKEN_ASSIGN;
+            break;
+        case '!':
+            if (following == '=') { kind = TOKEN_NOT_EQUAL; next++; } else kind = TOKEN_BANG;
+            break;
+        case '<':
+            if (following == '=') { kind = TOKEN_LESS_EQUAL; next++; } else kind = TOKEN_LESS;
+            break;
+        case '>':
+            if (following == '=') { kind = TOKEN_GREATER_EQUAL; next++; } else kind = TOKEN_GREATER;
+            break;
+        case '+':
+            if (following == '+') { kind = TOKEN_INCREMENT; next++; } else kind = TOKEN_PLUS;
+            break;
+        case '-':
+            if (following == '-') { kind = TOKEN_DECREMENT; next++; } else kind = TOKEN_MINUS;
+            break;
+        case '&':
+            if (following == '&') { kind = TOKEN_AMP_AMP; next++; }
+            break;
+        case '|':
+            if (following == '|') { kind = TOKEN_PIPE_PIPE; next++; }
+            break;
+        default:
+            break;
+        }
+    }
+
+    token->kind = kind;
+    token->length = (size_t)(next - p);
+    lexer->cursor = next;
+    if (kind == TOKEN_BLOCK_COMMENT) lexer_count_lines(lexer, p, next);
+}
+
+// Bump allocator for everything that lives as long as one translation unit.
+// Blocks start small and double up to ARENA_MAX_BLOCK_SIZE.
+#define ARENA_MIN_BLOCK_SIZE (64 * 1024)
+#define ARENA_MAX_BLOCK_SIZE (4 * 1024 * 1024)
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+    max_align_t data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *head;
+    size_t allocation_count; // Objects handed out
+    size_t block_count;      // malloc() calls actually made
+    size_t bytes_used;
+    size_t bytes_reserved;
+} Arena;
+
+// Zeroed, pointer-aligned storage that stays valid until arena_free().
+// Blocks are never reused, so they are still zero from calloc().
+static void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    ArenaBlock *block = arena->head;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = block != NULL ? block->capacity * 2 : ARENA_MIN_BLOCK_SIZE;
+        if (capacity > ARENA_MAX_BLOCK_SIZE) capacity = ARENA_MAX_BLOCK_SIZE;
+        if (capacity < size) capacity = size;
+        // calloc() hands back fresh pages without touching them again
+        block = calloc(1, sizeof(ArenaBlock) + capacity);
+        if (block == NULL) {
+            fprintf(stderr, "bminor2c: out of memory\n");
+            exit(1);
+        }
+        block->next = arena->head;
+        block->used = 0;
+        block->capacity = capacity;
+        arena->head = block;
+        arena->block_count++;
+        arena->bytes_reserved += capacity;
+    }
+    void *result = (char *)block->data + block->used;
+    block->used += size;
+    arena->allocation_count++;
+    arena->bytes_used += size;
+    return result;
+}
+
+// Release every block at once
+static void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    memset(arena, 0, sizeof(*arena));
+}
+
+// Start over for another translation unit, keeping the newest (largest)
+// block and clearing what was handed out from it
+static void arena_reset(Arena *arena) {
+    ArenaBlock *kept = arena->head;
+    if (kept == NULL) return;
+    arena->head = kept->next;
+    arena_free(arena);
+    memset(kept->data, 0, kept->used);
+    kept->used = 0;
+    kept->next = NULL;
+    arena->head = kept;
+    arena->block_count = 1;
+    arena->bytes_reserved = kept->capacity;
+}
+
+// Identifiers are interned once while parsing: each distinct spelling gets a
+// dense integer id, and everything after the parser compares ids
+typedef struct {
+    const char *text;
+    int length;
+    uint32_t hash;
+} InternedName;
+
+typedef struct {
+    InternedName *names;    // Indexed by id
+    int count;
+    int capacity;
+    int *slots;             // Open addressing; holds id + 1, 0 when empty
+    uint32_t slot_mask;
+    struct Arena *copies;   // When set, spellings are copied here instead of pointing into the input
+} Interner;
+
+static uint32_t hash_name(const char *text, int length) {
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void *checked_realloc(void *pointer, size_t size) {
+    void *result = realloc(pointer, size);
+    if (result == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
+    return result;
+}
+
+static void interner_grow_slots(Interner *interner) {
+    uint32_t slot_count = interner->slot_mask ? (interner->slot_mask + 1) * 2 : 1024;
+    free(interner->slots);
+    interner->slots = checked_realloc(NULL, slot_count * sizeof(int));
+    memset(interner->slots, 0, slot_count * sizeof(int));
+    interner->slot_mask = slot_count - 1;
+    for (int id = 0; id < interner->count; id++) {
+        uint32_t slot = interner->names[id].hash & interner->slot_mask;
+        while (interner->slots[slot] != 0) slot = (slot + 1) & interner->slot_mask;
+        interner->slots[slot] = id + 1;
+    }
+}
+
+// Id of the identifier spelled text[0..length); unless the interner copies
+// spellings, the text must outlive it
+static int intern(Interner *interner, const char *text, int length) {
+    // Keep the table at most half full
+    if ((uint32_t)interner->count * 2 >= interner->slot_mask) interner_grow_slots(interner);
+
+    uint32_t hash = hash_name(text, length);
+    uint32_t slot = hash & interner->slot_mask;
+    while (interner->slots[slot] != 0) {
+        const InternedName *name = &interner->names[interner->slots[slot] - 1];
+        if (name->hash == hash && name->length == length && memcmp(name->text, text, (size_t)length) == 0) {
+            return interner->slots[slot] - 1;
+        }
+        slot = (slot + 1) & interner->slot_mask;
+    }
+
+    if (interner->count == interner->capacity) {
+        interner->capacity = interner->capacity ? interner->capacity * 2 : 256;
+        interner->names = checked_realloc(interner->names, (size_t)interner->capacity * sizeof(InternedName));
+    }
+    if (interner->copies != NULL) {
+        char *copy = arena_alloc(interner->copies, (size_t)length);
+        memcpy(copy, text, (size_t)length);
+        text = copy;
+    }
+    int id = interner->count++;
+    interner->names[id] = (InternedName){ text, length, hash };
+    interner->slots[slot] = id + 1;
+    return id;
+}
+
+static void interner_free(Interner *interner) {
+    free(interner->names);
+    free(interner->slots);
+    memset(interner, 0, sizeof(*interner));
+}
+
+// Bminor types
+typedef enum {
+    TYPE_VOID,
+    TYPE_INTEGER,
+    TYPE_BOOLEAN,
+    TYPE_CHAR,
+    TYPE_STRING,
+    TYPE_ARRAY,
+    TYPE_FUNCTION
+} TypeKind;
+
+typedef struct Type {
+    TypeKind kind;
+    struct Type *subtype;   // Element type of an array, return type of a function
+    struct Expr *size;      // Array size, if one was given
+    struct Param *params;   // Function parameters
+} Type;
+
+typedef struct Param {
+    const char *name;
+    int name_length;
+    int name_id;
+    Type *type;
+    struct Symbol *symbol;  // Set when the function body is resolved
+    struct Param *next;
+} Param;
+
+typedef enum {
+    EXPR_NAME,
+    EXPR_INTEGER_LITERAL,
+    EXPR_BOOLEAN_LITERAL,
+    EXPR_CHAR_LITERAL,
+    EXPR_STRING_LITERAL,
+    EXPR_NUMBER_LITERAL,    // Literal with a fractional part
+    EXPR_INITIALIZER,       // { a, b, c }
+    EXPR_NEW_ARRAY,         // new array [size]
+    EXPR_INDEX,             // left[right]
+    EXPR_CALL,              // left(arguments)
+    EXPR_UNARY,             // op left
+    EXPR_POSTFIX,           // left op
+    EXPR_BINARY,            // left op right
+    EXPR_ASSIGN             // left = right
+} ExprKind;
+
+typedef struct Expr {
+    ExprKind kind;
+    bool real;                  // Arithmetic on a literal with a fractional part; set by the parser
+    union {
+        TokenKind op;           // Operator of unary, postfix and binary expressions
+        int name_id;            // Interned spelling of a name
+    };
+    int line;
+    int length;                 // Length of text
+    const char *text;           // Name or literal spelling, pointing into the input
+    union {
+        struct Expr *left;
+        long long value;        // Integer and boolean literal value
+    };
+    union {
+        struct Expr *right;
+        struct Expr *arguments; // Call arguments and initializer elements
+        struct Symbol *symbol;  // What a name refers to, once resolved
+    };
+    struct Expr *next;          // Next element of an argument or print list
+} Expr;
+
+// Comments are kept so they can be carried into the generated C
+typedef struct Comment {
+    const char *text;
+    int length;
+    int line;
+    bool blank_before;
+    struct Comment *next;
+} Comment;
+
+typedef struct Decl {
+    const char *name;
+    int name_length;
+    int name_id;
+    int line;
+    struct Symbol *symbol;
+    Type *type;
+    Expr *value;            // Initializer
+    struct Stmt *body;      // Function body; NULL for a prototype
+} Decl;
+
+typedef enum {
+    STMT_DECL,
+    STMT_EXPR,
+    STMT_PRINT,
+    STMT_RETURN,
+    STMT_IF,
+    STMT_FOR,
+    STMT_BLOCK,
+    STMT_UNHANDLED          // Could not be parsed; kept as source text
+} StmtKind;
+
+typedef struct Stmt {
+    StmtKind kind;
+    int line;
+    bool blank_before;
+    Comment *comments;          // Comments on the lines before the statement
+    Comment *trailing_comment;  // Comment after the statement on its last line
+    Decl *decl;                 // STMT_DECL, or a for loop's declaration
+    Expr *init;                 // For loop initializer
+    Expr *expr;                 // Expression, return value, condition, print list
+    Expr *step;                 // For loop increment
+    struct Stmt *body;          // Block contents, if/for body
+    struct Stmt *else_body;
+    Comment *closing_comments;  // Comments before a block's closing brace
+    const char *text;           // STMT_UNHANDLED source lines
+    int text_length;
+    struct Stmt *next;
+} Stmt;
+
+typedef struct {
+    Stmt *items;                // Top-level declarations
+    Comment *trailing_comments;
+} Program;
+
+typedef struct {
+    Lexer lexer;
+    Token current;
+    Token previous;
+    int previous_end_line;      // Line the previous token or comment ended on
+    Comment *pending;           // Comments read ahead of the current token
+    Comment **pending_tail;
+    Arena *arena;
+    Interner *interner;
+    Diagnostics *diagnostics;
+    const char *input_end;
+    bool skip_bodies;           // Parse only the headers of functions (--cache)
+    const char *skipped_body;   // Where the last skipped body started
+    bool reached_end;           // The end of the input has been lexed (--stream)
+    bool error;
+    int error_count;
+} Parser;
+
+// Everything needed to rewind the parser to the start of a statement
+typedef struct {
+    Lexer lexer;
+    Token current;
+    Token previous;
+    int previous_end_line;
+    Comment *pending;
+    Comment **pending_tail;
+} ParserMark;
+
+static void parser_advance(Parser *parser) {
+    parser->previous = parser->current;
+    parser->previous_end_line = parser->lexer.line;
+    for (;;) {
+        int last_line = parser->lexer.line;
+        lexer_next(&parser->lexer, &parser->current);
+        if (parser->current.kind == TOKEN_EOF) parser->reached_end = true;
+        if (parser->current.kind != TOKEN_LINE_COMMENT && parser->current.kind != TOKEN_BLOCK_COMMENT) break;
+
+        Comment *comment = arena_alloc(parser->arena, sizeof(Comment));
+        comment->text = parser->current.start;
+        comment->length = (int)parser->current.length;
+        comment->line = parser->current.line;
+        comment->blank_before = parser->current.line > last_line + 1 && last_line > 0;
+        *parser->pending_tail = comment;
+        parser->pending_tail = &comment->next;
+    }
+}
+
+// Parse a slice of a larger input that starts on `line`, right after a token
+// that ended on `previous_end_line` (0 at the very start of the input)
+static void parser_init_at(Parser *parser, const char *source, size_t length, int line, int previous_end_line,
+                           Arena *arena, Interner *interner, Diagnostics *diagnostics) {
+    memset(parser, 0, sizeof(*parser));
+    lexer_init(&parser->lexer, source, length);
+    parser->lexer.line = line;
+    parser->pending_tail = &parser->pending;
+    parser->arena = arena;
+    parser->interner = interner;
+    parser->diagnostics = diagnostics;
+    parser->input_end = source + length;
+    parser_advance(parser);
+    parser->previous_end_line = previous_end_line;
+}
+
+static void parser_init(Parser *parser, const char *source, size_t length, Arena *arena, Interner *interner,
+                        Diagnostics *diagnostics) {
+    parser_init_at(parser, source, length, 1, 0, arena, interner, diagnostics);
+}
+
+static ParserMark parser_mark(const Parser *parser) {
+    ParserMark mark = { parser->lexer, parser->current, parser->previous, parser->previous_end_line,
+                        parser->pending, parser->pending_tail };
+    return mark;
+}
+
+static void parser_rewind(Parser *parser, const ParserMark *mark) {
+    parser->lexer = mark->lexer;
+    parser->current = mark->current;
+    parser->previous = mark->previous;
+    parser->previous_end_line = mark->previous_end_line;
+    parser->pending = mark->pending;
+    parser->pending_tail = mark->pending_tail;
+    *parser->pending_tail = NULL;
+}
+
+// Detach the comments read so far
+static Comment *parser_take_comments(Parser *parser) {
+    Comment *comments = parser->pending;
+    parser->pending = NULL;
+    parser->pending_tail = &parser->pending;
+    return comments;
+}
+
+// Detach a comment that sits on the same line as the token just consumed
+static Comment *parser_take_trailing_comment(Parser *parser) {
+    Comment *comment = parser->pending;
+    if (comment == NULL || comment->line != parser->previous.line) return NULL;
+    parser->pending = comment->next;
+    if (parser->pending == NULL) parser->pending_tail = &parser->pending;
+    comment->next = NULL;
+    return comment;
+}
+
+static bool parser_check(const Parser *parser, TokenKind kind) {
+    return parser->current.kind == kind;
+}
+
+static bool parser_match(Parser *parser, TokenKind kind) {
+    if (parser->current.kind != kind) return false;
+    parser_advance(parser);
+    return true;
+}
+
+static bool parser_expect(Parser *parser, TokenKind kind) {
+    if (parser_match(parser, kind)) return true;
+    parser->error = true;
+    return false;
+}
+
+// Kind of the token after the current one, without consuming anything
+static TokenKind parser_peek(const Parser *parser) {
+    Lexer lookahead = parser->lexer;
+    Token token;
+    do {
+        lexer_next(&lookahead, &token);
+    } while (token.kind == TOKEN_LINE_COMMENT || token.kind == TOKEN_BLOCK_COMMENT);
+    return token.kind;
+}
+
+static Expr *new_expr(Parser *parser, ExprKind kind, const Token *token) {
+    Expr *expr = arena_alloc(parser->arena, sizeof(Expr));
+    expr->kind = kind;
+    expr->line = token->line;
+    expr->text = token->start;
+    expr->length = (int)token->length;
+    return expr;
+}
+
+static Type *new_type(Parser *parser, TypeKind kind) {
+    Type *type = arena_alloc(parser->arena, sizeof(Type));
+    type->kind = kind;
+    return type;
+}
+
+static Stmt *new_stmt(Parser *parser, StmtKind kind, int line) {
+    Stmt *stmt = arena_alloc(parser->arena, sizeof(Stmt));
+    stmt->kind = kind;
+    stmt->line = line;
+    return stmt;
+}
+
+static Expr *parse_expression(Parser *parser);
+
+// Comma-separated expressions up to (not including) the closing token
+static Expr *parse_expression_list(Parser *parser, TokenKind close) {
+    Expr *first = NULL;
+    Expr **tail = &first;
+    if (parser_check(parser, close)) return NULL;
+    do {
+        Expr *expr = parse_expression(parser);
+        if (parser->error) return first;
+        *tail = expr;
+        tail = &expr->next;
+    } while (parser_match(parser, TOKEN_COMMA));
+    return first;
+}
+
+static Expr *parse_primary(Parser *parser) {
+    Token token = parser->current;
+    switch (token.kind) {
+    case TOKEN_IDENTIFIER: {
+        parser_advance(parser);
+        Expr *expr = new_expr(parser, EXPR_NAME, &token);
+        expr->name_id = intern(parser->interner, token.start, (int)token.length);
+        return expr;
+    }
+    case TOKEN_NUMBER: {
+        parser_advance(parser);
+        bool fractional = memchr(token.start, '.', token.length) != NULL;
+        Expr *expr = new_expr(parser, fractional ? EXPR_NUMBER_LITERAL : EXPR_INTEGER_LITERAL, &token);
+        if (!fractional) expr->value = strtoll(token.start, NULL, 10);
+        expr->real = fractional;
+        return expr;
+    }
+    case TOKEN_TRUE:
+    case TOKEN_FALSE: {
+        parser_advance(parser);
+        Expr *expr = new_expr(parser, EXPR_BOOLEAN_LITERAL, &token);
+        expr->value = token.kind == TOKEN_TRUE;
+        return expr;
+    }
+    case TOKEN_CHAR_LITERAL:
+        parser_advance(parser);
+        return new_expr(parser, EXPR_CHAR_LITERAL, &token);
+    case TOKEN_STRING_LITERAL:
+        parser_advance(parser);
+        return new_expr(parser, EXPR_STRING_LITERAL, &token);
+    case TOKEN_LEFT_PAREN: {
+        parser_advance(parser);
+        Expr *expr = parse_expression(parser);
+        parser_expect(parser, TOKEN_RIGHT_PAREN);
+        return expr;
+    }
+    case TOKEN_LEFT_BRACE: {
+        parser_advance(parser);
+        Expr *expr = new_expr(parser, EXPR_INITIALIZER, &token);
+        expr->arguments = parse_expression_list(parser, TOKEN_RIGHT_BRACE);
+        parser_expect(parser, TOKEN_RIGHT_BRACE);
+        return expr;
+    }
+    case TOKEN_NEW: {
+        parser_advance(parser);
+        Expr *expr = new_expr(parser, EXPR_NEW_ARRAY, &token);
+        if (parser_expect(parser, TOKEN_ARRAY) && parser_expect(parser, TOKEN_LEFT_BRACKET)) {
+            expr->left = parse_expression(parser);
+            parser_expect(parser, TOKEN_RIGHT_BRACKET);
+        }
+        return expr;
+    }
+    default:
+        parser->error = true;
+        return new_expr(parser, EXPR_NAME, &token);
+    }
+}
+
+static Expr *parse_postfix(Parser *parser) {
+    Expr *expr = parse_primary(parser);
+    while (!parser->error) {
+        Token token = parser->current;
+        if (parser_match(parser, TOKEN_LEFT_BRACKET)) {
+            Expr *index = new_expr(parser, EXPR_INDEX, &token);
+            index->left = expr;
+            index->right = parse_expression(parser);
+            parser_expect(parser, TOKEN_RIGHT_BRACKET);
+            expr = index;
+        } else if (parser_match(parser, TOKEN_LEFT_PAREN)) {
+            Expr *call = new_expr(parser, EXPR_CALL, &token);
+            call->left = expr;
+            call->arguments = parse_expression_list(parser, TOKEN_RIGHT_PAREN);
+            parser_expect(parser, TOKEN_RIGHT_PAREN);
+            expr = call;
+        } else if (token.kind == TOKEN_INCREMENT || token.kind == TOKEN_DECREMENT) {
+            parser_advance(parser);
+            Expr *postfix = new_expr(parser, EXPR_POSTFIX, &token);
+            postfix->op = token.kind;
+            postfix->left = expr;
+            expr = postfix;
+        } else {
+            break;
+        }
+    }
+    return expr;
+}
+
+// Unary minus and logical not bind tighter than ^
+static Expr *parse_unary(Parser *parser) {
+    Token token = parser->current;
+    if (token.kind == TOKEN_MINUS || token.kind == TOKEN_NOT || token.kind == TOKEN_BANG) {
+        parser_advance(parser);
+        Expr *expr = new_expr(parser, EXPR_UNARY, &token);
+        expr->op = token.kind == TOKEN_BANG ? TOKEN_NOT : token.kind;
+        expr->left = parse_unary(parser);
+        expr->real = expr->op == TOKEN_MINUS && expr->left->real;
+        return expr;
+    }
+    return parse_postfix(parser);
+}
+
+static Expr *new_binary(Parser *parser, const Token *token, Expr *left, Expr *right) {
+    Expr *expr = new_expr(parser, EXPR_BINARY, token);
+    expr->op = token->kind == TOKEN_AMP_AMP ? TOKEN_AND : token->kind == TOKEN_PIPE_PIPE ? TOKEN_OR : token->kind;
+    expr->left = left;
+    expr->right = right;
+    switch (expr->op) {
+    case TOKEN_PLUS: case TOKEN_MINUS: case TOKEN_STAR: case TOKEN_SLASH: case TOKEN_CARET:
+        expr->real = left->real || right->real;
+        break;
+    default:
+        break;
+    }
+    return expr;
+}
+
+// Exponentiation is right-associative
+static Expr *parse_power(Parser *parser) {
+    Expr *base = parse_unary(parser);
+    Token token = parser->current;
+    if (!parser->error && parser_match(parser, TOKEN_CARET)) {
+        return new_binary(parser, &token, base, parse_power(parser));
+    }
+    return base;
+}
+
+static int binary_precedence(TokenKind kind) {
+    switch (kind) {
+    case TOKEN_OR: case TOKEN_PIPE_PIPE: return 1;
+    case TOKEN_AND: case TOKEN_AMP_AMP: return 2;
+    case TOKEN_EQUAL: case TOKEN_NOT_EQUAL:
+    case TOKEN_LESS: case TOKEN_LESS_EQUAL: case TOKEN_GREATER: case TOKEN_GREATER_EQUAL: return 3;
+    case TOKEN_PLUS: case TOKEN_MINUS: return 4;
+    case TOKEN_STAR: case TOKEN_SLASH: case TOKEN_PERCENT: return 5;
+    default: return 0;
+    }
+}
+
+// Left-associative binary operators by precedence climbing
+static Expr *parse_binary(Parser *parser, int min_precedence) {
+    Expr *left = parse_power(parser);
+    for (;;) {
+        Token token = parser->current;
+        int precedence = binary_precedence(token.kind);
+        if (parser->error || precedence == 0 || precedence < min_precedence) return left;
+        parser_advance(parser);
+        left = new_binary(parser, &token, left, parse_binary(parser, precedence + 1));
+    }
+}
+
+static Expr *parse_expression(Parser *parser) {
+    Expr *left = parse_binary(parser, 1);
+    Token token = parser->current;
+    if (!parser->error && parser_match(parser, TOKEN_ASSIGN)) {
+        Expr *assign = new_expr(parser, EXPR_ASSIGN, &token);
+        assign->left = left;
+        assign->right = parse_expression(parser);
+        return assign;
+    }
+    return left;
+}
+
+static Type *parse_type(Parser *parser);
+
+// name: type, name: type, ...
+static Param *parse_params(Parser *parser) {
+    Param *first = NULL;
+    Param **tail = &first;
+    if (parser_check(parser, TOKEN_RIGHT_PAREN)) return NULL;
+    do {
+        Token name = parser->current;
+        if (!parser_expect(parser, TOKEN_IDENTIFIER) || !parser_expect(parser, TOKEN_COLON)) return first;
+        Param *param = arena_alloc(parser->arena, sizeof(Param));
+        param->name = name.start;
+        param->name_length = (int)name.length;
+        param->name_id = intern(parser->interner, name.start, (int)name.length);
+        param->type = parse_type(parser);
+        *tail = param;
+        tail = &param->next;
+    } while (!parser->error && parser_match(parser, TOKEN_COMMA));
+    return first;
+}
+
+static Type *parse_type(Parser *parser) {
+    Token token = parser->current;
+    parser_advance(parser);
+    switch (token.kind) {
+    case TOKEN_INTEGER: return new_type(parser, TYPE_INTEGER);
+    case TOKEN_BOOLEAN: return new_type(parser, TYPE_BOOLEAN);
+    case TOKEN_CHAR: return new_type(parser, TYPE_CHAR);
+    case TOKEN_STRING: return new_type(parser, TYPE_STRING);
+    case TOKEN_VOID: return new_type(parser, TYPE_VOID);
+    case TOKEN_ARRAY: {
+        Type *type = new_type(parser, TYPE_ARRAY);
+        if (parser_expect(parser, TOKEN_LEFT_BRACKET)) {
+            if (!parser_check(parser, TOKEN_RIGHT_BRACKET)) type->size = parse_expression(parser);
+            parser_expect(parser, TOKEN_RIGHT_BRACKET);
+        }
+        if (!parser->error) type->subtype = parse_type(parser);
+        return type;
+    }
+    case TOKEN_FUNCTION: {
+        Type *type = new_type(parser, TYPE_FUNCTION);
+        type->subtype = parse_type(parser);
+        if (!parser->error && parser_expect(parser, TOKEN_LEFT_PAREN)) {
+            type->params = parse_params(parser);
+            parser_expect(parser, TOKEN_RIGHT_PAREN);
+        }
+        return type;
+    }
+    default:
+        parser->error = true;
+        return new_type(parser, TYPE_VOID);
+    }
+}
+
+static Stmt *parse_statement(Parser *parser);
+static Stmt *parse_block(Parser *parser);
+
+// Step over a function body without building it. Comments inside it are
+// dropped; those after the closing brace are read as usual.
+static void parser_skip_body(Parser *parser) {
+    parser->skipped_body = parser->current.start;
+    int depth = 0;
+    for (;;) {
+        if (parser_check(parser, TOKEN_LEFT_BRACE)) {
+            depth++;
+        } else if (parser_check(parser, TOKEN_RIGHT_BRACE)) {
+            if (--depth == 0) break;
+        } else if (parser_check(parser, TOKEN_EOF)) {
+            parser->error = true;
+            return;
+        }
+        parser_advance(parser);
+    }
+    parser_take_comments(parser);
+    parser_advance(parser); // '}'
+}
+
+// name: type [= value]; or name: function type (params) = { body }
+// The for-loop form leaves the terminator to the caller.
+static Decl *parse_decl(Parser *parser, bool in_for_header) {
+    Decl *decl = arena_alloc(parser->arena, sizeof(Decl));
+    decl->name = parser->current.start;
+    decl->name_length = (int)parser->current.length;
+    decl->name_id = intern(parser->interner, decl->name, decl->name_length);
+    decl->line = parser->current.line;
+    parser_advance(parser); // Name
+    parser_advance(parser); // ':'
+    decl->type = parse_type(parser);
+    if (parser->error) return decl;
+
+    if (parser_match(parser, TOKEN_ASSIGN)) {
+        if (decl->type->kind == TYPE_FUNCTION) {
+            if (!parser_check(parser, TOKEN_LEFT_BRACE)) parser->error = true;
+            else if (parser->skip_bodies) parser_skip_body(parser);
+            else decl->body = parse_block(parser);
+            return decl;
+        }
+        decl->value = parse_expression(parser);
+    }
+    if (!in_for_header) parser_expect(parser, TOKEN_SEMICOLON);
+    return decl;
+}
+
+// Skip the tokens of a statement that failed to parse, line by line like the
+// original translator: up to and including its ';', to the end of its line, or
+// up to a brace that starts a block on the next lines or closes the enclosing one
+static void parser_skip_statement(Parser *parser) {
+    int brace_depth = 0;
+    int paren_depth = 0;
+    bool consumed = false;
+    while (!parser_check(parser, TOKEN_EOF)) {
+        TokenKind kind = parser->current.kind;
+        if (brace_depth == 0) {
+            if (kind == TOKEN_RIGHT_BRACE) return;
+            if (consumed && paren_depth <= 0 && parser->current.line > parser->previous.line) return;
+            if (kind == TOKEN_SEMICOLON) {
+                parser_advance(parser);
+                return;
+            }
+            if (kind == TOKEN_LEFT_BRACE && consumed) {
+                Lexer lookahead = parser->lexer;
+                Token next;
+                lexer_next(&lookahead, &next);
+                if (next.line > parser->current.line) return;
+            }
+        }
+        if (kind == TOKEN_LEFT_BRACE) brace_depth++;
+        else if (kind == TOKEN_RIGHT_BRACE) brace_depth--;
+        else if (kind == TOKEN_LEFT_PAREN || kind == TOKEN_LEFT_BRACKET) paren_depth++;
+        else if (kind == TOKEN_RIGHT_PAREN || kind == TOKEN_RIGHT_BRACKET) paren_depth--;
+        parser_advance(parser);
+        consumed = true;
+    }
+}
+
+// Re-parse the statement at `mark` as an unhandled span of source lines
+static Stmt *parse_unhandled(Parser *parser, const ParserMark *mark) {
+    parser_rewind(parser, mark);
+    parser->error = false;
+    parser->error_count++;
+
+    const Token *first = &parser->current;
+    Stmt *stmt = new_stmt(parser, STMT_UNHANDLED, first->line);
+    stmt->text = first->start;
+    // Make sure at least one token is consumed so parsing always progresses
+    if (parser_check(parser, TOKEN_RIGHT_BRACE) || parser_check(parser, TOKEN_LEFT_BRACE)) parser_advance(parser);
+    else parser_skip_statement(parser);
+
+    const char *end = parser->previous.start + parser->previous.length;
+    const char *line_end = memchr(end, '\n', (size_t)(parser->input_end - end));
+    if (line_end == NULL) line_end = parser->input_end;
+    while (line_end > stmt->text && isspace((unsigned char)line_end[-1])) line_end--;
+    stmt->text_length = (int)(line_end - stmt->text);
+    diagnose(parser->diagnostics, stmt->line, "unhandled statement");
+    return stmt;
+}
+
+static Stmt *parse_statement_body(Parser *parser) {
+    Token token = parser->current;
+    switch (token.kind) {
+    case TOKEN_LEFT_BRACE:
+        return parse_block(parser);
+
+    case TOKEN_IF: {
+        parser_advance(parser);
+        Stmt *stmt = new_stmt(parser, STMT_IF, token.line);
+        if (!parser_expect(parser, TOKEN_LEFT_PAREN)) return stmt;
+        stmt->expr = parse_expression(parser);
+        if (!parser_expect(parser, TOKEN_RIGHT_PAREN)) return stmt;
+        stmt->body = parse_statement(parser);
+        if (!parser->error && parser_match(parser, TOKEN_ELSE)) {
+            stmt->else_body = parse_statement(parser);
+        }
+        return stmt;
+    }
+
+    case TOKEN_FOR: {
+        parser_advance(parser);
+        Stmt *stmt = new_stmt(parser, STMT_FOR, token.line);
+        if (!parser_expect(parser, TOKEN_LEFT_PAREN)) return stmt;
+        if (parser_check(parser, TOKEN_IDENTIFIER) && parser_peek(parser) == TOKEN_COLON) {
+            stmt->decl = parse_decl(parser, true);
+        } else if (!parser_check(parser, TOKEN_SEMICOLON)) {
+            stmt->init = parse_expression(parser);
+        }
+        if (parser->error || !parser_expect(parser, TOKEN_SEMICOLON)) return stmt;
+        if (!parser_check(parser, TOKEN_SEMICOLON)) stmt->expr = parse_expression(parser);
+        if (parser->error || !parser_expect(parser, TOKEN_SEMICOLON)) return stmt;
+        if (!parser_check(parser, TOKEN_RIGHT_PAREN)) stmt->step = parse_expression(parser);
+        if (parser->error || !parser_expect(parser, TOKEN_RIGHT_PAREN)) return stmt;
+        stmt->body = parse_statement(parser);
+        return stmt;
+    }
+
+    case TOKEN_PRINT: {
+        parser_advance(parser);
+        Stmt *stmt = new_stmt(parser, STMT_PRINT, token.line);
+        stmt->expr = parse_expression_list(parser, TOKEN_SEMICOLON);
+        parser_expect(parser, TOKEN_SEMICOLON);
+        return stmt;
+    }
+
+    case TOKEN_RETURN: {
+        parser_advance(parser);
+        Stmt *stmt = new_stmt(parser, STMT_RETURN, token.line);
+        if (!parser_check(parser, TOKEN_SEMICOLON)) stmt->expr = parse_expression(parser);
+        parser_expect(parser, TOKEN_SEMICOLON);
+        return stmt;
+    }
+
+    default:
+        if (token.kind == TOKEN_IDENTIFIER && parser_peek(parser) == TOKEN_COLON) {
+            Stmt *stmt = new_stmt(parser, STMT_DECL, token.line);
+            stmt->decl = parse_decl(parser, false);
+            return stmt;
+        } else {
+            Stmt *stmt = new_stmt(parser, STMT_EXPR, token.line);
+            stmt->expr = parse_expression(parser);
+            parser_expect(parser, TOKEN_SEMICOLON);
+            return stmt;
+        }
+    }
+}
+
+// A statement with the comments that precede and follow it
+static Stmt *parse_statement(Parser *parser) {
+    Comment *comments = parser_take_comments(parser);
+    bool blank_before = parser->current.line > parser->previous_end_line + 1 && parser->previous_end_line > 0;
+    if (comments != NULL) {
+        Comment *last = comments;
+        while (last->next != NULL) last = last->next;
+        int last_end_line = last->line;
+        for (int i = 0; i < last->length; i++) {
+            if (last->text[i] == '\n') last_end_line++;
+        }
+        blank_before = parser->current.line > last_end_line + 1;
+    }
+
+    ParserMark mark = parser_mark(parser);
+    Stmt *stmt = parse_statement_body(parser);
+    if (parser->error) stmt = parse_unhandled(parser, &mark);
+
+    stmt->comments = comments;
+    stmt->blank_before = blank_before;
+    stmt->trailing_comment = parser_take_trailing_comment(parser);
+    return stmt;
+}
+
+static Stmt *parse_block(Parser *parser) {
+    Stmt *block = new_stmt(parser, STMT_BLOCK, parser->current.line);
+    parser_advance(parser); // '{'
+    Stmt **tail = &block->body;
+    while (!parser_check(parser, TOKEN_RIGHT_BRACE) && !parser_check(parser, TOKEN_EOF)) {
+        Stmt *stmt = parse_statement(parser);
+        *tail = stmt;
+        tail = &stmt->next;
+    }
+    block->closing_comments = parser_take_comments(parser);
+    if (!parser_match(parser, TOKEN_RIGHT_BRACE)) parser->error = true;
+    return block;
+}
+
+// Top-level items are declarations; anything else is kept as unhandled text
+static Stmt *parse_item(Parser *parser) {
+    if (parser_check(parser, TOKEN_IDENTIFIER) && parser_peek(parser) == TOKEN_COLON) return parse_statement(parser);
+    Comment *comments = parser_take_comments(parser);
+    ParserMark mark = parser_mark(parser);
+    Stmt *stmt = parse_unhandled(parser, &mark);
+    stmt->comments = comments;
+    return stmt;
+}
+
+static Program *parse_program(Parser *parser) {
+    Program *program = arena_alloc(parser->arena, sizeof(Program));
+    Stmt **tail = &program->items;
+    while (!parser_check(parser, TOKEN_EOF)) {
+        Stmt *stmt = parse_item(parser);
+        *tail = stmt;
+        tail = &stmt->next;
+    }
+    program->trailing_comments = parser_take_comments(parser);
+    return program;
+}
+
+// Where the top-level item just parsed ends: after its last token, or after
+// the comment that trails it on the same line. *line is set to the line that
+// position is on.
+static const char *parsed_item_end(const Parser *parser, const Stmt *item, int *line) {
+    const char *end = parser->previous.start + parser->previous.length;
+    *line = parser->previous_end_line;
+    const Comment *trailing = item->trailing_comment;
+    if (trailing != NULL) {
+        end = trailing->text + trailing->length;
+        *line = trailing->line;
+        for (int i = 0; i < trailing->length; i++) {
+            if (trailing->text[i] == '\n') (*line)++;
+        }
+    }
+    return end;
+}
+
+// Where a name was declared
+typedef enum {
+    SYMBOL_GLOBAL,
+    SYMBOL_PARAM,
+    SYMBOL_LOCAL
+} SymbolKind;
+
+typedef struct Symbol {
+    SymbolKind kind;
+    int name_id;
+    int scope_depth;
+    Type *type;
+    struct Symbol *shadowed;    // Outer binding of the same name, restored on scope exit
+    struct Symbol *scope_next;  // Next symbol declared in the same scope
+    bool assigned;              // Target of an assignment or ++/-- anywhere (-O)
+    int references;             // Uses left after folding (-O)
+    const struct Expr *constant; // Literal value of a never-assigned global (-O)
+    int uses;                   // Appearances in the function being emitted
+    int indexed_uses;           // ... of which as the array of a[i]
+    int argument_uses;          // ... of which as an argument of a call
+    bool live_heap_array;       // Freed when its scope ends or on return
+    int slot;                   // --run: register of a local, index of a global or function
+} Symbol;
+
+// Scoped symbol table. bindings[name_id] is the innermost visible symbol for
+// that name, so every lookup is a single array access.
+typedef struct {
+    Symbol **bindings;
+    int binding_capacity;
+    Symbol **scopes;            // Symbols declared in each open scope
+    int depth;
+    int scope_capacity;
+    Arena *arena;
+    const Interner *interner;
+    Diagnostics *diagnostics;
+    int error_count;
+} SymbolTable;
+
+static void symbols_init(SymbolTable *table, Arena *arena, const Interner *interner, Diagnostics *diagnostics) {
+    memset(table, 0, sizeof(*table));
+    table->arena = arena;
+    table->interner = interner;
+    table->diagnostics = diagnostics;
+}
+
+static void symbols_free(SymbolTable *table) {
+    free(table->bindings);
+    free(table->scopes);
+    memset(table, 0, sizeof(*table));
+}
+
+static void symbols_push_scope(SymbolTable *table) {
+    if (table->depth == table->scope_capacity) {
+        table->scope_capacity = table->scope_capacity ? table->scope_capacity * 2 : 16;
+        table->scopes = checked_realloc(table->scopes, (size_t)table->scope_capacity * sizeof(Symbol *));
+    }
+    table->scopes[table->depth++] = NULL;
+}
+
+static void symbols_pop_scope(SymbolTable *table) {
+    Symbol *symbol = table->scopes[--table->depth];
+    for (; symbol != NULL; symbol = symbol->scope_next) table->bindings[symbol->name_id] = symbol->shadowed;
+}
+
+static Symbol *symbols_lookup(const SymbolTable *table, int name_id) {
+    return name_id < table->binding_capacity ? table->bindings[name_id] : NULL;
+}
+
+static Symbol *symbols_declare(SymbolTable *table, SymbolKind kind, int name_id, Type *type) {
+    if (name_id >= table->binding_capacity) {
+        int capacity = table->binding_capacity ? table->binding_capacity : 256;
+        while (capacity <= name_id) capacity *= 2;
+        table->bindings = checked_realloc(table->bindings, (size_t)capacity * sizeof(Symbol *));
+        memset(table->bindings + table->binding_capacity, 0, (size_t)(capacity - table->binding_capacity) * sizeof(Symbol *));
+        table->binding_capacity = capacity;
+    }
+    Symbol *symbol = arena_alloc(table->arena, sizeof(Symbol));
+    symbol->kind = kind;
+    symbol->name_id = name_id;
+    symbol->scope_depth = table->depth;
+    symbol->type = type;
+
+    Symbol *existing = table->bindings[name_id];
+    if (existing != NULL && existing->scope_depth == table->depth) {
+        // Redeclaration in the same scope (e.g. a prototype then its
+        // definition) replaces the binding rather than shadowing it
+        symbol->shadowed = existing->shadowed;
+    } else {
+        symbol->shadowed = existing;
+        symbol->scope_next = table->scopes[table->depth - 1];
+        table->scopes[table->depth - 1] = symbol;
+    }
+    table->bindings[name_id] = symbol;
+    return symbol;
+}
+
+static void resolve_expr_list(SymbolTable *table, Expr *expr);
+
+static void resolve_expr(SymbolTable *table, Expr *expr) {
+    if (expr == NULL) return;
+    switch (expr->kind) {
+    case EXPR_NAME:
+        expr->symbol = symbols_lookup(table, expr->name_id);
+        if (expr->symbol == NULL) {
+            diagnose(table->diagnostics, expr->line, "'%.*s' is not declared", expr->length, expr->text);
+            table->error_count++;
+        }
+        break;
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_BOOLEAN_LITERAL:
+    case EXPR_CHAR_LITERAL:
+    case EXPR_STRING_LITERAL:
+    case EXPR_NUMBER_LITERAL:
+        break;
+    case EXPR_INITIALIZER:
+        resolve_expr_list(table, expr->arguments);
+        break;
+    case EXPR_NEW_ARRAY:
+    case EXPR_UNARY:
+    case EXPR_POSTFIX:
+        resolve_expr(table, expr->left);
+        break;
+    case EXPR_CALL:
+        resolve_expr(table, expr->left);
+        resolve_expr_list(table, expr->arguments);
+        break;
+    case EXPR_INDEX:
+    case EXPR_BINARY:
+    case EXPR_ASSIGN:
+        resolve_expr(table, expr->left);
+        resolve_expr(table, expr->right);
+        break;
+    }
+}
+
+// Resolve every element of an argument, initializer or print list
+static void resolve_expr_list(SymbolTable *table, Expr *expr) {
+    for (; expr != NULL; expr = expr->next) resolve_expr(table, expr);
+}
+
+// Initializer first, so `x: integer = x;` refers to an outer x
+static void resolve_decl(SymbolTable *table, Decl *decl, SymbolKind kind) {
+    if (decl->type->kind == TYPE_ARRAY && decl->type->size != NULL) resolve_expr(table, decl->type->size);
+    resolve_expr(table, decl->value);
+    decl->symbol = symbols_declare(table, kind, decl->name_id, decl->type);
+}
+
+static void resolve_stmt(SymbolTable *table, Stmt *stmt);
+
+static void resolve_stmts(SymbolTable *table, Stmt *stmt) {
+    for (; stmt != NULL; stmt = stmt->next) resolve_stmt(table, stmt);
+}
+
+static void resolve_stmt(SymbolTable *table, Stmt *stmt) {
+    switch (stmt->kind) {
+    case STMT_DECL:
+        resolve_decl(table, stmt->decl, SYMBOL_LOCAL);
+        break;
+    case STMT_EXPR:
+    case STMT_RETURN:
+        resolve_expr(table, stmt->expr);
+        break;
+    case STMT_PRINT:
+        resolve_expr_list(table, stmt->expr);
+        break;
+    case STMT_IF:
+        resolve_expr(table, stmt->expr);
+        resolve_stmt(table, stmt->body);
+        if (stmt->else_body != NULL) resolve_stmt(table, stmt->else_body);
+        break;
+    case STMT_FOR:
+        // A loop variable declared in the header is local to the loop
+        symbols_push_scope(table);
+        if (stmt->decl != NULL) resolve_decl(table, stmt->decl, SYMBOL_LOCAL);
+        resolve_expr(table, stmt->init);
+        resolve_expr(table, stmt->expr);
+        resolve_expr(table, stmt->step);
+        resolve_stmt(table, stmt->body);
+        symbols_pop_scope(table);
+        break;
+    case STMT_BLOCK:
+        symbols_push_scope(table);
+        resolve_stmts(table, stmt->body);
+        symbols_pop_scope(table);
+        break;
+    case STMT_UNHANDLED:
+        break;
+    }
+}
+
+// Bind every top-level name first so functions can refer to each other in
+// any order, then resolve initializers and function bodies
+// Initializer or body of a top-level declaration whose name is bound
+static void resolve_item(SymbolTable *table, Stmt *item) {
+    if (item->kind != STMT_DECL) return;
+    Decl *decl = item->decl;
+    if (decl->type->kind == TYPE_ARRAY && decl->type->size != NULL) resolve_expr(table, decl->type->size);
+    resolve_expr(table, decl->value);
+    if (decl->body == NULL) return;
+
+    // Parameters share a scope with the outermost block of the body
+    symbols_push_scope(table);
+    for (Param *param = decl->type->params; param != NULL; param = param->next) {
+        param->symbol = symbols_declare(table, SYMBOL_PARAM, param->name_id, param->type);
+    }
+    resolve_stmts(table, decl->body->body);
+    symbols_pop_scope(table);
+}
+
+static void resolve_program(SymbolTable *table, Program *program) {
+    symbols_push_scope(table);
+    for (Stmt *item = program->items; item != NULL; item = item->next) {
+        if (item->kind != STMT_DECL) continue;
+        Decl *decl = item->decl;
+        decl->symbol = symbols_declare(table, SYMBOL_GLOBAL, decl->name_id, decl->type);
+    }
+    for (Stmt *item = program->items; item != NULL; item = item->next) resolve_item(table, item);
+    symbols_pop_scope(table);
+}
+
+// Types of literals and of operators' results
+static Type integer_type = { TYPE_INTEGER, NULL, NULL, NULL };
+static Type boolean_type = { TYPE_BOOLEAN, NULL, NULL, NULL };
+static Type char_type = { TYPE_CHAR, NULL, NULL, NULL };
+static Type string_type = { TYPE_STRING, NULL, NULL, NULL };
+static Type void_type = { TYPE_VOID, NULL, NULL, NULL };
+
+// Static type of a resolved expression; void when it cannot be told
+static const Type *expr_type(const Expr *expr) {
+    switch (expr->kind) {
+    case EXPR_NAME:
+        return expr->symbol != NULL ? expr->symbol->type : &void_type;
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_NUMBER_LITERAL:
+        return &integer_type;
+    case EXPR_BOOLEAN_LITERAL:
+        return &boolean_type;
+    case EXPR_CHAR_LITERAL:
+        return &char_type;
+    case EXPR_STRING_LITERAL:
+        return &string_type;
+    case EXPR_INITIALIZER:
+    case EXPR_NEW_ARRAY:
+        return &void_type;
+    case EXPR_INDEX: {
+        const Type *array = expr_type(expr->left);
+        return array->kind == TYPE_ARRAY && array->subtype != NULL ? array->subtype : &void_type;
+    }
+    case EXPR_CALL: {
+        const Type *function = expr_type(expr->left);
+        return function->kind == TYPE_FUNCTION && function->subtype != NULL ? function->subtype : &void_type;
+    }
+    case EXPR_UNARY:
+        return expr->op == TOKEN_NOT ? &boolean_type : &integer_type;
+    case EXPR_POSTFIX:
+        return &integer_type;
+    case EXPR_BINARY:
+        switch (expr->op) {
+        case TOKEN_PLUS: case TOKEN_MINUS: case TOKEN_STAR: case TOKEN_SLASH: case TOKEN_PERCENT: case TOKEN_CARET:
+            return &integer_type;
+        default:
+            return &boolean_type;
+        }
+    case EXPR_ASSIGN:
+        return expr_type(expr->left);
+    }
+    return &void_type;
+}
+
+// Whether any expression in a tree satisfies a predicate
+typedef bool (*ExprPredicate)(const Expr *expr);
+
+static bool expr_any(const Expr *expr, ExprPredicate predicate) {
+    if (expr == NULL) return false;
+    if (predicate(expr)) return true;
+    switch (expr->kind) {
+    case EXPR_INITIALIZER:
+        for (const Expr *arg = expr->arguments; arg != NULL; arg = arg->next) {
+            if (expr_any(arg, predicate)) return true;
+        }
+        return false;
+    case EXPR_CALL:
+        for (const Expr *arg = expr->arguments; arg != NULL; arg = arg->next) {
+            if (expr_any(arg, predicate)) return true;
+        }
+        return expr_any(expr->left, predicate);
+    case EXPR_NEW_ARRAY:
+    case EXPR_UNARY:
+    case EXPR_POSTFIX:
+        return expr_any(expr->left, predicate);
+    case EXPR_INDEX:
+    case EXPR_BINARY:
+    case EXPR_ASSIGN:
+        return expr_any(expr->left, predicate) || expr_any(expr->right, predicate);
+    default:
+        return false;
+    }
+}
+
+static bool decl_any_expr(const Decl *decl, ExprPredicate predicate);
+
+static bool stmt_any_expr(const Stmt *stmt, ExprPredicate predicate) {
+    for (; stmt != NULL; stmt = stmt->next) {
+        bool found = false;
+        switch (stmt->kind) {
+        case STMT_DECL:
+            found = decl_any_expr(stmt->decl, predicate);
+            break;
+        case STMT_PRINT:
+            for (const Expr *arg = stmt->expr; arg != NULL && !found; arg = arg->next) found = expr_any(arg, predicate);
+            break;
+        case STMT_FOR:
+            found = (stmt->decl != NULL && decl_any_expr(stmt->decl, predicate)) || expr_any(stmt->init, predicate) ||
+                    expr_any(stmt->step, predicate);
+            /* fall through */
+        case STMT_IF:
+            found = found || expr_any(stmt->expr, predicate) || stmt_any_expr(stmt->body, predicate) ||
+                    stmt_any_expr(stmt->else_body, predicate);
+            break;
+        case STMT_BLOCK:
+            found = stmt_any_expr(stmt->body, predicate);
+            break;
+        case STMT_EXPR:
+        case STMT_RETURN:
+            found = expr_any(stmt->expr, predicate);
+            break;
+        case STMT_UNHANDLED:
+            break;
+        }
+        if (found) return true;
+    }
+    return false;
+}
+
+static bool decl_any_expr(const Decl *decl, ExprPredicate predicate) {
+    return (decl->type->kind == TYPE_ARRAY && expr_any(decl->type->size, predicate)) ||
+           expr_any(decl->value, predicate) || (decl->body != NULL && stmt_any_expr(decl->body, predicate));
+}
+
+// Constant folding and dead-branch elimination, enabled by -O. Runs on the
+// resolved tree and rewrites it in place; anything whose value would depend
+// on C's undefined behaviour (overflow, division by zero) is left alone.
+typedef struct {
+    Arena *arena;
+    int folded;     // Operators and names replaced by a literal
+    int removed;    // if/else arms dropped because their condition is constant
+} Folder;
+
+static bool is_constant(const Expr *expr) {
+    return expr->kind == EXPR_INTEGER_LITERAL || expr->kind == EXPR_BOOLEAN_LITERAL;
+}
+
+static bool has_side_effects(const Expr *expr) {
+    return expr->kind == EXPR_CALL || expr->kind == EXPR_ASSIGN || expr->kind == EXPR_POSTFIX;
+}
+
+// Overwrite a node with a copy of another, keeping its place in any list
+static void replace_expr(Expr *expr, const Expr *with) {
+    Expr *next = expr->next;
+    *expr = *with;
+    expr->next = next;
+}
+
+static void fold_to_integer(Folder *folder, Expr *expr, long long value) {
+    char *text = arena_alloc(folder->arena, 24);
+    expr->kind = EXPR_INTEGER_LITERAL;
+    expr->length = snprintf(text, 24, "%lld", value);
+    expr->text = text;
+    expr->value = value;
+    folder->folded++;
+}
+
+static void fold_to_boolean(Folder *folder, Expr *expr, bool value) {
+    expr->kind = EXPR_BOOLEAN_LITERAL;
+    expr->text = value ? "true" : "false";
+    expr->length = value ? 4 : 5;
+    expr->value = value;
+    folder->folded++;
+}
+
+static bool fits_int(long long value) {
+    return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// a ^ b with the same results as bminor_ipow(); false if it overflows
+static bool constant_power(long long base, long long exponent, long long *result) {
+    if (exponent < 0) {
+        *result = base == 1 ? 1 : base == -1 ? (exponent % 2 ? -1 : 1) : 0;
+        return true;
+    }
+    long long value = 1;
+    for (long long i = 0; i < exponent; i++) {
+        value *= base;
+        if (!fits_int(value)) return false;
+        if (value == 0 || value == 1) break;
+    }
+    // 1 and 0 stay put, but -1 alternates
+    if (base == -1) value = exponent % 2 ? -1 : 1;
+    *result = value;
+    return true;
+}
+
+// Arithmetic and comparisons on two integer literals
+static void fold_integer_binary(Folder *folder, Expr *expr) {
+    long long a = expr->left->value;
+    long long b = expr->right->value;
+    if (!fits_int(a) || !fits_int(b)) return;
+    long long result;
+    switch (expr->op) {
+    case TOKEN_PLUS: result = a + b; break;
+    case TOKEN_MINUS: result = a - b; break;
+    case TOKEN_STAR: result = a * b; break;
+    case TOKEN_SLASH:
+    case TOKEN_PERCENT:
+        if (b == 0) return;
+        result = expr->op == TOKEN_SLASH ? a / b : a % b;
+        break;
+    case TOKEN_CARET:
+        if (!constant_power(a, b, &result)) return;
+        break;
+    case TOKEN_EQUAL: fold_to_boolean(folder, expr, a == b); return;
+    case TOKEN_NOT_EQUAL: fold_to_boolean(folder, expr, a != b); return;
+    case TOKEN_LESS: fold_to_boolean(folder, expr, a < b); return;
+    case TOKEN_LESS_EQUAL: fold_to_boolean(folder, expr, a <= b); return;
+    case TOKEN_GREATER: fold_to_boolean(folder, expr, a > b); return;
+    case TOKEN_GREATER_EQUAL: fold_to_boolean(folder, expr, a >= b); return;
+    default: return;
+    }
+    if (fits_int(result)) fold_to_integer(folder, expr, result);
+}
+
+// and/or with at least one boolean literal operand. A left operand may only
+// be dropped when evaluating it has no effect.
+static void fold_logical(Folder *folder, Expr *expr) {
+    bool is_and = expr->op == TOKEN_AND;
+    const Expr *left = expr->left;
+    const Expr *right = expr->right;
+    if (left->kind == EXPR_BOOLEAN_LITERAL) {
+        // true and x, false or x => x; false and x, true or x => left, as x
+        // is never evaluated
+        replace_expr(expr, left->value == is_and ? right : left);
+        folder->folded++;
+    } else if (right->kind == EXPR_BOOLEAN_LITERAL && right->value == is_and) {
+        // x and true, x or false => x
+        replace_expr(expr, left);
+        folder->folded++;
+    } else if (right->kind == EXPR_BOOLEAN_LITERAL && !expr_any(left, has_side_effects)) {
+        // x and false, x or true => right
+        replace_expr(expr, right);
+        folder->folded++;
+    }
+}
+
+static void fold_expr(Folder *folder, Expr *expr);
+
+static void fold_expr_list(Folder *folder, Expr *expr) {
+    for (; expr != NULL; expr = expr->next) fold_expr(folder, expr);
+}
+
+static void fold_expr(Folder *folder, Expr *expr) {
+    if (expr == NULL) return;
+    switch (expr->kind) {
+    case EXPR_NAME:
+        if (expr->symbol != NULL && expr->symbol->constant != NULL) {
+            replace_expr(expr, expr->symbol->constant);
+            folder->folded++;
+        }
+        break;
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_BOOLEAN_LITERAL:
+    case EXPR_CHAR_LITERAL:
+    case EXPR_STRING_LITERAL:
+    case EXPR_NUMBER_LITERAL:
+    case EXPR_POSTFIX:
+        break;
+    case EXPR_INITIALIZER:
+    case EXPR_CALL:
+        fold_expr_list(folder, expr->arguments);
+        break;
+    case EXPR_NEW_ARRAY:
+        fold_expr(folder, expr->left);
+        break;
+    case EXPR_INDEX:
+        fold_expr(folder, expr->right);
+        break;
+    case EXPR_ASSIGN:
+        // The target is never a constant, but an element index may be
+        if (expr->left->kind == EXPR_INDEX) fold_expr(folder, expr->left->right);
+        fold_expr(folder, expr->right);
+        break;
+    case EXPR_UNARY:
+        fold_expr(folder, expr->left);
+        if (expr->op == TOKEN_MINUS && expr->left->kind == EXPR_INTEGER_LITERAL && fits_int(-expr->left->value)) {
+            fold_to_integer(folder, expr, -expr->left->value);
+        } else if (expr->op == TOKEN_NOT && expr->left->kind == EXPR_BOOLEAN_LITERAL) {
+            fold_to_boolean(folder, expr, !expr->left->value);
+        }
+        break;
+    case EXPR_BINARY:
+        fold_expr(folder, expr->left);
+        fold_expr(folder, expr->right);
+        if (expr->op == TOKEN_AND || expr->op == TOKEN_OR) {
+            fold_logical(folder, expr);
+        } else if (expr->left->kind == EXPR_INTEGER_LITERAL && expr->right->kind == EXPR_INTEGER_LITERAL) {
+            fold_integer_binary(folder, expr);
+        } else if (expr->left->kind == EXPR_BOOLEAN_LITERAL && expr->right->kind == EXPR_BOOLEAN_LITERAL &&
+                   (expr->op == TOKEN_EQUAL || expr->op == TOKEN_NOT_EQUAL)) {
+            fold_to_boolean(folder, expr, (expr->left->value == expr->right->value) == (expr->op == TOKEN_EQUAL));
+        }
+        break;
+    }
+}
+
+static void fold_decl(Folder *folder, Decl *decl) {
+    if (decl->type->kind == TYPE_ARRAY) fold_expr(folder, decl->type->size);
+    fold_expr(folder, decl->value);
+}
+
+static void fold_stmts(Folder *folder, Stmt **link);
+
+// Fold the body of an if or for. It is one statement, so when a constant if
+// there is replaced by nothing or by several statements they go in a block.
+// An else that folds away is simply dropped.
+static void fold_body(Folder *folder, Stmt **slot, bool optional) {
+    Stmt *body = *slot;
+    if (body == NULL) return;
+    fold_stmts(folder, slot);
+    if ((*slot == NULL && optional) || (*slot != NULL && (*slot)->next == NULL)) return;
+    Stmt *block = arena_alloc(folder->arena, sizeof(Stmt));
+    block->kind = STMT_BLOCK;
+    block->line = body->line;
+    block->body = *slot;
+    *slot = block;
+}
+
+static void fold_stmt(Folder *folder, Stmt *stmt) {
+    switch (stmt->kind) {
+    case STMT_DECL:
+        fold_decl(folder, stmt->decl);
+        break;
+    case STMT_EXPR:
+    case STMT_RETURN:
+        fold_expr(folder, stmt->expr);
+        break;
+    case STMT_PRINT:
+        fold_expr_list(folder, stmt->expr);
+        break;
+    case STMT_IF:
+        fold_expr(folder, stmt->expr);
+        fold_body(folder, &stmt->body, false);
+        fold_body(folder, &stmt->else_body, true);
+        break;
+    case STMT_FOR:
+        if (stmt->decl != NULL) fold_decl(folder, stmt->decl);
+        fold_expr(folder, stmt->init);
+        fold_expr(folder, stmt->expr);
+        fold_expr(folder, stmt->step);
+        fold_body(folder, &stmt->body, false);
+        break;
+    case STMT_BLOCK:
+        fold_stmts(folder, &stmt->body);
+        break;
+    case STMT_UNHANDLED:
+        break;
+    }
+}
+
+// Statements an if with a constant condition is replaced by: the taken arm,
+// with a block's braces removed when that cannot change what a name means
+static Stmt *taken_arm(const Stmt *stmt) {
+    Stmt *arm = stmt->expr->value ? stmt->body : stmt->else_body;
+    if (arm == NULL || arm->kind != STMT_BLOCK) return arm;
+    for (const Stmt *inner = arm->body; inner != NULL; inner = inner->next) {
+        if (inner->kind == STMT_DECL) return arm;
+    }
+    return arm->body;
+}
+
+// Fold each statement of a list, splicing taken arms in place of constant ifs
+static void fold_stmts(Folder *folder, Stmt **link) {
+    while (*link != NULL) {
+        Stmt *stmt = *link;
+        fold_stmt(folder, stmt);
+        if (stmt->kind != STMT_IF || stmt->expr == NULL || stmt->expr->kind != EXPR_BOOLEAN_LITERAL) {
+            link = &stmt->next;
+            continue;
+        }
+        folder->removed++;
+        Stmt *arm = taken_arm(stmt);
+        if (arm == NULL) {
+            *link = stmt->next;
+            continue;
+        }
+        // Comments above the if now sit above its first replacement
+        if (stmt->comments != NULL) {
+            Comment *last = stmt->comments;
+            while (last->next != NULL) last = last->next;
+            last->next = arm->comments;
+            arm->comments = stmt->comments;
+        }
+        arm->blank_before = stmt->blank_before;
+        *link = arm;
+        while (arm->next != NULL) arm = arm->next;
+        arm->next = stmt->next;
+        link = &arm->next;
+    }
+}
+
+static bool mark_assignment_target(const Expr *expr) {
+    const Expr *target = NULL;
+    if (expr->kind == EXPR_ASSIGN || expr->kind == EXPR_POSTFIX) target = expr->left;
+    if (target != NULL && target->kind == EXPR_NAME && target->symbol != NULL) target->symbol->assigned = true;
+    return false;
+}
+
+static bool count_reference(const Expr *expr) {
+    if (expr->kind == EXPR_NAME && expr->symbol != NULL) expr->symbol->references++;
+    return false;
+}
+
+// Fold the whole program. Integer and boolean globals that are never assigned
+// are replaced by their (folded) initializers and dropped once unused.
+static void fold_program(Folder *folder, Program *program) {
+    for (Stmt *item = program->items; item != NULL; item = item->next) {
+        if (item->kind == STMT_DECL) decl_any_expr(item->decl, mark_assignment_target);
+    }
+    for (Stmt *item = program->items; item != NULL; item = item->next) {
+        if (item->kind != STMT_DECL) continue;
+        Decl *decl = item->decl;
+        fold_decl(folder, decl);
+        Symbol *symbol = decl->symbol;
+        bool scalar = decl->type->kind == TYPE_INTEGER || decl->type->kind == TYPE_BOOLEAN;
+        if (scalar && decl->body == NULL && decl->value != NULL && is_constant(decl->value) && !symbol->assigned) {
+            symbol->constant = decl->value;
+        }
+        if (decl->body != NULL) fold_stmts(folder, &decl->body->body);
+    }
+
+    for (Stmt *item = program->items; item != NULL; item = item->next) {
+        if (item->kind == STMT_DECL) decl_any_expr(item->decl, count_reference);
+    }
+    for (Stmt **link = &program->items; *link != NULL;) {
+        Stmt *item = *link;
+        if (item->kind != STMT_DECL || item->decl->symbol->constant == NULL || item->decl->symbol->references > 0) {
+            link = &item->next;
+            continue;
+        }
+        // Keep the comments of a dropped global with whatever follows it
+        if (item->comments != NULL) {
+            Comment **following = item->next != NULL ? &item->next->comments : &program->trailing_comments;
+            Comment *last = item->comments;
+            while (last->next != NULL) last = last->next;
+            last->next = *following;
+            *following = item->comments;
+            if (item->next != NULL) item->next->blank_before = item->blank_before;
+        }
+        *link = item->next;
+    }
+}
+
+// Largest `new array` with a constant size, in elements, placed on the stack
+#define STACK_ARRAY_LIMIT 1024
+
+// A heap-allocated array and the symbol it is bound to
+typedef struct {
+    const char *name;
+    int length;
+    struct Symbol *symbol;
+} HeapArray;
+
+// A timed loop whose body is being emitted (--profile); a return inside it
+// has to stop its timer
+typedef struct ProfileLoop {
+    int site;                   // Numbers the loop's variables within its function
+    struct ProfileLoop *outer;
+} ProfileLoop;
+
+// Code generation state for one translation unit
+typedef struct {
+    OutputBuffer *out;
+    int indent;
+    bool in_function_body;
+    bool buffered_output;       // Fully buffer stdout from the start of main
+    bool parallel;              // Split independent array loops across threads
+    bool profile;               // Time every function and loop (--profile)
+    unsigned included;          // NEEDS_* whose headers and helpers are emitted
+    const char *return_type;    // C return type of the function being emitted
+    const Decl *function;       // Function being emitted
+    int profile_loop_count;     // Loops timed so far in the function
+    ProfileLoop *profile_loop;  // Innermost timed loop being emitted
+    HeapArray *live;            // Arrays to free on scope exit, innermost last
+    int live_count;
+    int live_capacity;
+    HeapArray *global_arrays;   // Globals allocated at the start of main (names owned)
+    int global_array_count;
+} CodeGen;
+
+static void codegen_free(CodeGen *gen) {
+    for (int i = 0; i < gen->global_array_count; i++) free((char *)gen->global_arrays[i].name);
+    free(gen->global_arrays);
+    free(gen->live);
+}
+
+// C precedence levels used to decide where parentheses are needed
+enum {
+    PREC_ASSIGN = 1,
+    PREC_OR,
+    PREC_AND,
+    PREC_EQUALITY,
+    PREC_RELATIONAL,
+    PREC_SHIFT,
+    PREC_ADDITIVE,
+    PREC_MULTIPLICATIVE,
+    PREC_UNARY,
+    PREC_POSTFIX
+};
+
+// How an a ^ b expression is lowered
+typedef enum {
+    POWER_ONE,          // b == 0: 1
+    POWER_BASE,         // b == 1: a
+    POWER_PRODUCT,      // Small constant b and a side-effect-free a: a * a * ...
+    POWER_SHIFT,        // a == 2 and a constant b of at most 30: 1 << b
+    POWER_HELPER,       // bminor_ipow(a, b), exponentiation by squaring
+    POWER_LIBM          // Real operands: pow(a, b)
+} PowerForm;
+
+// Largest constant exponent written out as repeated multiplication
+#define MAX_PRODUCT_EXPONENT 4
+
+// Whether an expression involves a literal with a fractional part. The
+// parser works this out bottom-up, so asking at every ^ of a long chain
+// does not walk the chain again.
+static bool expr_is_real(const Expr *expr) {
+    return expr->real;
+}
+
+// Names, literals and indexing by them can be evaluated twice
+static bool expr_is_simple(const Expr *expr) {
+    switch (expr->kind) {
+    case EXPR_NAME:
+    case EXPR_INTEGER_LITERAL:
+        return true;
+    case EXPR_INDEX:
+        return expr_is_simple(expr->left) && expr_is_simple(expr->right);
+    case EXPR_UNARY:
+        return expr->op == TOKEN_MINUS && expr_is_simple(expr->left);
+    default:
+        return false;
+    }
+}
+
+static PowerForm classify_power(const Expr *expr) {
+    const Expr *base = expr->left;
+    const Expr *exponent = expr->right;
+    if (expr_is_real(base) || expr_is_real(exponent)) return POWER_LIBM;
+    if (exponent->kind == EXPR_INTEGER_LITERAL) {
+        if (exponent->value == 0 && expr_is_simple(base)) return POWER_ONE;
+        if (exponent->value == 1) return POWER_BASE;
+        // -O can leave a negative literal here, which bminor_ipow() handles
+        if (exponent->value >= 2 && exponent->value <= MAX_PRODUCT_EXPONENT && expr_is_simple(base)) {
+            return POWER_PRODUCT;
+        }
+    }
+    // 1 << b is only defined for 0 <= b <= 30, which a variable exponent
+    // cannot promise; bminor_ipow() gives 0 past that, like --run
+    if (base->kind == EXPR_INTEGER_LITERAL && base->value == 2 && exponent->kind == EXPR_INTEGER_LITERAL &&
+        exponent->value >= 0 && exponent->value <= 30) {
+        return POWER_SHIFT;
+    }
+    return POWER_HELPER;
+}
+
+static int expr_precedence(const Expr *expr);
+
+static int power_precedence(const Expr *expr) {
+    switch (classify_power(expr)) {
+    case POWER_BASE: return expr_precedence(expr->left);
+    case POWER_PRODUCT: return PREC_MULTIPLICATIVE;
+    case POWER_SHIFT: return PREC_SHIFT;
+    default: return PREC_POSTFIX;
+    }
+}
+
+static int expr_precedence(const Expr *expr) {
+    switch (expr->kind) {
+    case EXPR_ASSIGN: return PREC_ASSIGN;
+    case EXPR_UNARY: return PREC_UNARY;
+    case EXPR_INTEGER_LITERAL: return expr->value < 0 ? PREC_UNARY : PREC_POSTFIX;  // Folded by -O
+    case EXPR_BINARY:
+        switch (expr->op) {
+        case TOKEN_OR: return PREC_OR;
+        case TOKEN_AND: return PREC_AND;
+        case TOKEN_EQUAL: case TOKEN_NOT_EQUAL: return PREC_EQUALITY;
+        case TOKEN_LESS: case TOKEN_LESS_EQUAL: case TOKEN_GREATER: case TOKEN_GREATER_EQUAL: return PREC_RELATIONAL;
+        case TOKEN_PLUS: case TOKEN_MINUS: return PREC_ADDITIVE;
+        case TOKEN_STAR: case TOKEN_SLASH: case TOKEN_PERCENT: return PREC_MULTIPLICATIVE;
+        case TOKEN_CARET: return power_precedence(expr);
+        default: return PREC_POSTFIX;
+        }
+    default: return PREC_POSTFIX;
+    }
+}
+
+static const char *c_operator(TokenKind op) {
+    switch (op) {
+    case TOKEN_OR: return "||";
+    case TOKEN_AND: return "&&";
+    case TOKEN_NOT: return "!";
+    case TOKEN_EQUAL: return "==";
+    case TOKEN_NOT_EQUAL: return "!=";
+    case TOKEN_LESS: return "<";
+    case TOKEN_LESS_EQUAL: return "<=";
+    case TOKEN_GREATER: return ">";
+    case TOKEN_GREATER_EQUAL: return ">=";
+    case TOKEN_PLUS: return "+";
+    case TOKEN_MINUS: return "-";
+    case TOKEN_STAR: return "*";
+    case TOKEN_SLASH: return "/";
+    case TOKEN_PERCENT: return "%";
+    case TOKEN_INCREMENT: return "++";
+    case TOKEN_DECREMENT: return "--";
+    default: return "?";
+    }
+}
+
+static const char *c_type_name(const Type *type) {
+    switch (type->kind) {
+    case TYPE_INTEGER: return "int";
+    case TYPE_BOOLEAN: return "bool";
+    case TYPE_CHAR: return "char";
+    case TYPE_STRING: return "char*";
+    default: return "void";
+    }
+}
+
+static void emit_expr(CodeGen *gen, const Expr *expr, int min_precedence);
+static void emit_power(CodeGen *gen, const Expr *expr);
+
+static void emit_expr_list(CodeGen *gen, const Expr *expr) {
+    for (; expr != NULL; expr = expr->next) {
+        emit_expr(gen, expr, PREC_ASSIGN);
+        if (expr->next != NULL) output_write(gen->out, ", ", 2);
+    }
+}
+
+// Bminor's ^ is integer exponentiation; libm's pow() is only used when an
+// operand is a real literal
+static void emit_power(CodeGen *gen, const Expr *expr) {
+    OutputBuffer *out = gen->out;
+    switch (classify_power(expr)) {
+    case POWER_ONE:
+        output_write(out, "1", 1);
+        break;
+    case POWER_BASE:
+        emit_expr(gen, expr->left, PREC_ASSIGN);
+        break;
+    case POWER_PRODUCT:
+        for (long long i = 0; i < expr->right->value; i++) {
+            if (i > 0) output_write(out, " * ", 3);
+            emit_expr(gen, expr->left, PREC_MULTIPLICATIVE + 1);
+        }
+        break;
+    case POWER_SHIFT:
+        output_puts(out, "1 << ");
+        emit_expr(gen, expr->right, PREC_ADDITIVE);
+        break;
+    case POWER_HELPER:
+    case POWER_LIBM:
+        output_puts(out, classify_power(expr) == POWER_HELPER ? "bminor_ipow(" : "pow(");
+        emit_expr(gen, expr->left, PREC_ASSIGN);
+        output_write(out, ", ", 2);
+        emit_expr(gen, expr->right, PREC_ASSIGN);
+        output_write(out, ")", 1);
+        break;
+    }
+}
+
+static void emit_expr(CodeGen *gen, const Expr *expr, int min_precedence) {
+    OutputBuffer *out = gen->out;
+    int precedence = expr_precedence(expr);
+    bool parenthesize = precedence < min_precedence;
+    if (parenthesize) output_write(out, "(", 1);
+
+    switch (expr->kind) {
+    case EXPR_NAME:
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_BOOLEAN_LITERAL:
+    case EXPR_CHAR_LITERAL:
+    case EXPR_STRING_LITERAL:
+    case EXPR_NUMBER_LITERAL:
+        output_write(out, expr->text, (size_t)expr->length);
+        break;
+    case EXPR_INITIALIZER:
+        output_write(out, "{", 1);
+        emit_expr_list(gen, expr->arguments);
+        output_write(out, "}", 1);
+        break;
+    case EXPR_NEW_ARRAY:
+        // Only meaningful as a declaration initializer; see emit_decl()
+        output_puts(out, "NULL");
+        break;
+    case EXPR_INDEX:
+        emit_expr(gen, expr->left, PREC_POSTFIX);
+        output_write(out, "[", 1);
+        emit_expr(gen, expr->right, PREC_ASSIGN);
+        output_write(out, "]", 1);
+        break;
+    case EXPR_CALL:
+        emit_expr(gen, expr->left, PREC_POSTFIX);
+        output_write(out, "(", 1);
+        emit_expr_list(gen, expr->arguments);
+        output_write(out, ")", 1);
+        break;
+    case EXPR_UNARY: {
+        output_puts(out, c_operator(expr->op));
+        // Keep "- -x" and "- -1" from turning into "--x" and "--1"
+        const Expr *operand = expr->left;
+        bool negative = (operand->kind == EXPR_UNARY && operand->op == TOKEN_MINUS) ||
+                        (operand->kind == EXPR_INTEGER_LITERAL && operand->value < 0);
+        if (expr->op == TOKEN_MINUS && negative) output_write(out, " ", 1);
+        emit_expr(gen, operand, PREC_UNARY);
+        break;
+    }
+    case EXPR_POSTFIX:
+        emit_expr(gen, expr->left, PREC_POSTFIX);
+        output_puts(out, c_operator(expr->op));
+        break;
+    case EXPR_BINARY:
+        if (expr->op == TOKEN_CARET) {
+            emit_power(gen, expr);
+        } else {
+            emit_expr(gen, expr->left, precedence);
+            output_write(out, " ", 1);
+            output_puts(out, c_operator(expr->op));
+            output_write(out, " ", 1);
+            emit_expr(gen, expr->right, precedence + 1);
+        }
+        break;
+    case EXPR_ASSIGN:
+        emit_expr(gen, expr->left, PREC_UNARY);
+        output_write(out, " = ", 3);
+        emit_expr(gen, expr->right, PREC_ASSIGN);
+        break;
+    }
+
+    if (parenthesize) output_write(out, ")", 1);
+}
+
+static void emit_comment(CodeGen *gen, const Comment *comment) {
+    if (comment->blank_before) output_write(gen->out, "\n", 1);
+    output_indent(gen->out, gen->indent);
+    output_line(gen->out, comment->text, (size_t)comment->length);
+}
+
+static void emit_comments(CodeGen *gen, const Comment *comment) {
+    for (; comment != NULL; comment = comment->next) emit_comment(gen, comment);
+}
+
+// End a line, carrying over a comment that followed the statement
+static void emit_line_end(CodeGen *gen, const Stmt *stmt) {
+    if (stmt != NULL && stmt->trailing_comment != NULL) {
+        output_write(gen->out, "  ", 2);
+        output_write(gen->out, stmt->trailing_comment->text, (size_t)stmt->trailing_comment->length);
+    }
+    output_write(gen->out, "\n", 1);
+}
+
+static bool is_small_constant_size(const Expr *size) {
+    return size->kind == EXPR_INTEGER_LITERAL && size->value > 0 && size->value <= STACK_ARRAY_LIMIT;
+}
+
+// Count how names are used; an array used other than by indexing or as a
+// call argument escapes
+static bool count_array_use(const Expr *expr) {
+    if (expr->kind == EXPR_NAME && expr->symbol != NULL) expr->symbol->uses++;
+    if (expr->kind == EXPR_INDEX && expr->left->kind == EXPR_NAME && expr->left->symbol != NULL) {
+        expr->left->symbol->indexed_uses++;
+    }
+    if (expr->kind == EXPR_CALL) {
+        for (const Expr *arg = expr->arguments; arg != NULL; arg = arg->next) {
+            if (arg->kind == EXPR_NAME && arg->symbol != NULL) arg->symbol->argument_uses++;
+        }
+    }
+    return false;
+}
+
+// Whether an array can outlive its scope: it is assigned or returned. A
+// callee is taken to only borrow an array it is passed.
+static bool array_escapes(const Symbol *symbol) {
+    return symbol == NULL || symbol->uses > symbol->indexed_uses + symbol->argument_uses;
+}
+
+static bool uses_live_array(const Expr *expr) {
+    return expr->kind == EXPR_NAME && expr->symbol != NULL && expr->symbol->live_heap_array;
+}
+
+// Whether a declaration is a global array that main has to allocate
+static bool is_allocated_global(const Decl *decl) {
+    const Expr *value = decl->value;
+    return decl->type->kind == TYPE_ARRAY && value != NULL && value->kind == EXPR_NEW_ARRAY &&
+           !(value->left->kind == EXPR_INTEGER_LITERAL && value->left->value > 0);
+}
+
+// Remember a global that main allocates and frees. Items copied from the
+// cache are noted without being emitted, so the name is copied.
+static void note_global_array(CodeGen *gen, const Decl *decl) {
+    if (!is_allocated_global(decl)) return;
+    if (gen->global_array_count % 16 == 0) {
+        gen->global_arrays = checked_realloc(gen->global_arrays, (size_t)(gen->global_array_count + 16) * sizeof(HeapArray));
+    }
+    char *name = checked_realloc(NULL, (size_t)decl->name_length);
+    memcpy(name, decl->name, (size_t)decl->name_length);
+    gen->global_arrays[gen->global_array_count++] = (HeapArray){ name, decl->name_length, decl->symbol };
+}
+
+static void push_live_array(CodeGen *gen, const char *name, int length, Symbol *symbol) {
+    if (gen->live_count == gen->live_capacity) {
+        gen->live_capacity = gen->live_capacity ? gen->live_capacity * 2 : 16;
+        gen->live = checked_realloc(gen->live, (size_t)gen->live_capacity * sizeof(HeapArray));
+    }
+    gen->live[gen->live_count++] = (HeapArray){ name, length, symbol };
+    if (symbol != NULL) symbol->live_heap_array = true;
+}
+
+// One free() line per live array from index `first` on, innermost first.
+// The first line's indentation may already have been written.
+static void emit_frees(CodeGen *gen, int first, bool indented) {
+    for (int i = gen->live_count - 1; i >= first; i--) {
+        if (!indented) output_indent(gen->out, gen->indent);
+        output_printf(gen->out, "free(%.*s);\n", gen->live[i].length, gen->live[i].name);
+        indented = false;
+    }
+}
+
+// End the scope that began when `first` arrays were live, freeing the rest
+// unless control cannot reach the end of the scope
+static void close_live_arrays(CodeGen *gen, int first, bool reachable) {
+    if (reachable) emit_frees(gen, first, false);
+    for (int i = first; i < gen->live_count; i++) {
+        if (gen->live[i].symbol != NULL) gen->live[i].symbol->live_heap_array = false;
+    }
+    gen->live_count = first;
+}
+
+// `new array [n]`. A global of constant size is a C array; any other global
+// is allocated by a helper that main calls first. In a function, an array
+// that is only indexed or passed to calls does not outlive its scope: it
+// goes on the stack when it is small and of constant size, and is freed at
+// the end of the scope otherwise. Arrays assigned or returned keep their
+// allocation.
+static void emit_new_array(CodeGen *gen, const Decl *decl) {
+    OutputBuffer *out = gen->out;
+    const char *element = c_type_name(decl->type->subtype);
+    const Expr *size = decl->value->left;
+    Symbol *symbol = decl->symbol;
+    bool escapes = array_escapes(symbol);
+
+    if (!gen->in_function_body ? !is_allocated_global(decl) : !escapes && is_small_constant_size(size)) {
+        output_printf(out, "%s %.*s[%lld];", element, decl->name_length, decl->name, size->value);
+        return;
+    }
+    if (!gen->in_function_body) {
+        output_printf(out, "%s *%.*s;\n", element, decl->name_length, decl->name);
+        output_printf(out, "static void bminor_allocate_%.*s(void) {\n", decl->name_length, decl->name);
+        output_printf(out, "    %.*s = malloc(", decl->name_length, decl->name);
+        emit_expr(gen, size, PREC_MULTIPLICATIVE);
+        output_printf(out, " * sizeof(%s));\n", element);
+        output_printf(out, "    if (%.*s == NULL) { fprintf(stderr, \"Memory allocation failed!\\n\"); exit(1); }\n}",
+                      decl->name_length, decl->name);
+        note_global_array(gen, decl);
+        return;
+    }
+    output_printf(out, "%s *%.*s = malloc(", element, decl->name_length, decl->name);
+    emit_expr(gen, size, PREC_MULTIPLICATIVE);
+    output_printf(out, " * sizeof(%s));", element);
+    if (!escapes) push_live_array(gen, decl->name, decl->name_length, symbol);
+}
+
+// Declaration of a variable or array, without the terminating line end
+static void emit_variable(CodeGen *gen, const Decl *decl) {
+    OutputBuffer *out = gen->out;
+    const Type *type = decl->type;
+    const Expr *value = decl->value;
+
+    if (type->kind == TYPE_ARRAY) {
+        const char *element = c_type_name(type->subtype);
+        if (value != NULL && value->kind == EXPR_NEW_ARRAY) {
+            emit_new_array(gen, decl);
+            return;
+        }
+        output_printf(out, "%s %.*s[", element, decl->name_length, decl->name);
+        if (type->size != NULL) emit_expr(gen, type->size, PREC_ASSIGN);
+        output_write(out, "]", 1);
+    } else {
+        output_printf(out, "%s %.*s", c_type_name(type), decl->name_length, decl->name);
+    }
+    if (value != NULL) {
+        output_write(out, " = ", 3);
+        emit_expr(gen, value, PREC_ASSIGN);
+    }
+    output_write(out, ";", 1);
+}
+
+static void emit_params(CodeGen *gen, const Param *param) {
+    for (; param != NULL; param = param->next) {
+        if (param->type->kind == TYPE_ARRAY) {
+            output_printf(gen->out, "%s *%.*s", c_type_name(param->type->subtype), param->name_length, param->name);
+        } else {
+            output_printf(gen->out, "%s %.*s", c_type_name(param->type), param->name_length, param->name);
+        }
+        if (param->next != NULL) output_write(gen->out, ", ", 2);
+    }
+}
+
+static const Stmt *emit_stmt(CodeGen *gen, const Stmt *stmt);
+
+// Statements of a block at one deeper level, followed by the closing brace
+static void emit_block_contents(CodeGen *gen, const Stmt *block) {
+    int first_live = gen->live_count;
+    const Stmt *last = NULL;
+    gen->indent++;
+    if (block != NULL && block->kind == STMT_BLOCK) {
+        for (const Stmt *stmt = block->body; stmt != NULL; stmt = stmt->next) stmt = last = emit_stmt(gen, stmt);
+        emit_comments(gen, block->closing_comments);
+    } else {
+        // A single statement, or several once -O has spliced a block's contents in
+        for (const Stmt *stmt = block; stmt != NULL; stmt = stmt->next) stmt = last = emit_stmt(gen, stmt);
+    }
+    close_live_arrays(gen, first_live, last == NULL || last->kind != STMT_RETURN);
+    gen->indent--;
+    output_indent(gen->out, gen->indent);
+    output_write(gen->out, "}", 1);
+}
+
+// Print arguments whose text can go straight into the format string
+static bool is_format_literal(const Expr *arg) {
+    return arg->kind == EXPR_STRING_LITERAL || arg->kind == EXPR_INTEGER_LITERAL || arg->kind == EXPR_BOOLEAN_LITERAL;
+}
+
+// Most arguments one merged print call may take
+#define PRINT_MERGE_LIMIT 32
+
+// Whether a print makes calls or assignments. Merged, they would run before
+// the text of the prints ahead of it is written, and in no set order with
+// the other arguments.
+static bool print_has_side_effects(const Stmt *stmt) {
+    for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) {
+        if (expr_any(arg, has_side_effects)) return true;
+    }
+    return false;
+}
+
+// Whether a print has a string literal with a \0 (or \x0) escape. C stops
+// writing the call's output there, so nothing may be merged in after it.
+static bool print_has_nul(const Stmt *stmt) {
+    for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) {
+        if (arg->kind != EXPR_STRING_LITERAL) continue;
+        const char *end = arg->text + arg->length - 1;
+        for (const char *text = arg->text + 1; text + 1 < end; text++) {
+            if (*text != '\\') continue;
+            const char *digits = text + (text[1] == 'x' ? 2 : 1);
+            const char *digit = digits;
+            while (digit < end && *digit == '0') digit++;
+            bool more = digit < end && (text[1] == 'x' ? isxdigit((unsigned char)*digit)
+                                                       : *digit >= '0' && *digit <= '7' && digit < digits + 3);
+            if (digit > digits && !more) return true;
+            text++;
+        }
+    }
+    return false;
+}
+
+// Last print of the run starting at `stmt` that shares one call with it:
+// prints that follow each other with no comment or blank line in between.
+// A print with side effects stays on its own, and one with a \0 ends a run.
+static const Stmt *print_run_end(const Stmt *stmt) {
+    if (print_has_side_effects(stmt)) return stmt;
+    int arguments = 0;
+    for (;;) {
+        for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) arguments++;
+        const Stmt *next = stmt->next;
+        if (next == NULL || print_has_nul(stmt) || next->kind != STMT_PRINT || next->comments != NULL || next->blank_before ||
+            stmt->trailing_comment != NULL || arguments >= PRINT_MERGE_LIMIT || print_has_side_effects(next)) {
+            return stmt;
+        }
+        stmt = next;
+    }
+}
+
+// Whether a string literal ends in an octal escape of fewer than three digits
+// or in a hex escape, which a digit written right after it would extend
+static bool ends_in_open_escape(const char *text, const char *end) {
+    bool open = false;
+    while (text < end) {
+        if (*text != '\\' || text + 1 == end) {
+            text++;
+            open = false;
+        } else if (text[1] == 'x') {
+            for (text += 2; text < end && isxdigit((unsigned char)*text); text++) {}
+            open = text == end;
+        } else if (text[1] >= '0' && text[1] <= '7') {
+            const char *digits = text + 1;
+            for (text = digits; text < end && text < digits + 3 && *text >= '0' && *text <= '7'; text++) {}
+            open = text == end && text < digits + 3;
+        } else {
+            text += 2;
+            open = false;
+        }
+    }
+    return open;
+}
+
+// Text of a literal print argument, for a format string (with '%' doubled)
+// or for fputs(). `open_escape` carries over from the text written before:
+// when that ended in an escape a digit would extend, the string is closed
+// and reopened ("\1" "2") before text that starts with one.
+static void emit_literal_text(OutputBuffer *out, const Expr *arg, bool format, bool *open_escape) {
+    char first = arg->kind == EXPR_BOOLEAN_LITERAL ? (arg->value ? 't' : 'f')
+                 : arg->kind == EXPR_INTEGER_LITERAL ? (arg->value < 0 ? '-' : '0')
+                 : arg->length > 2 ? arg->text[1] : '\0';
+    if (first == '\0') return;
+    if (*open_escape && isxdigit((unsigned char)first)) output_puts(out, "\" \"");
+    *open_escape = false;
+    if (arg->kind == EXPR_BOOLEAN_LITERAL) {
+        output_puts(out, arg->value ? "true" : "false");
+    } else if (arg->kind == EXPR_INTEGER_LITERAL) {
+        output_printf(out, "%d", (int)arg->value);
+    } else {
+        // String literals go in as is, escapes included
+        const char *text = arg->text + 1;
+        const char *end = arg->text + arg->length - 1;
+        while (text < end) {
+            const char *percent = format ? memchr(text, '%', (size_t)(end - text)) : NULL;
+            if (percent == NULL) percent = end;
+            output_write(out, text, (size_t)(percent - text));
+            if (percent < end) output_write(out, "%%", 2);
+            text = percent + 1;
+        }
+        *open_escape = ends_in_open_escape(arg->text + 1, end);
+    }
+}
+
+// One output call for the prints first..last. Literal-only output becomes
+// fputs(), a lone string, character or boolean fputs() or putchar(), and
+// anything else printf() with literals folded into the format string and a
+// conversion chosen from each other argument's type.
+static void emit_print(CodeGen *gen, const Stmt *first, const Stmt *last) {
+    OutputBuffer *out = gen->out;
+    const Expr *value = NULL;
+    int value_count = 0;
+    bool has_text = false;
+    for (const Stmt *stmt = first;; stmt = stmt->next) {
+        for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) {
+            if (!is_format_literal(arg)) {
+                value = arg;
+                value_count++;
+            } else if (arg->kind != EXPR_STRING_LITERAL || arg->length > 2) {
+                has_text = true;
+            }
+        }
+        if (stmt == last) break;
+    }
+
+    TypeKind value_type = value != NULL ? expr_type(value)->kind : TYPE_VOID;
+    if (value_count == 0) {
+        output_puts(out, "fputs(\"");
+        bool open_escape = false;
+        for (const Stmt *stmt = first;; stmt = stmt->next) {
+            for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) {
+                emit_literal_text(out, arg, false, &open_escape);
+            }
+            if (stmt == last) break;
+        }
+        output_puts(out, "\", stdout);");
+        return;
+    }
+    if (value_count == 1 && !has_text && value_type != TYPE_INTEGER) {
+        if (value_type == TYPE_CHAR) {
+            output_puts(out, "putchar(");
+            emit_expr(gen, value, PREC_ASSIGN);
+            output_write(out, ");", 2);
+            return;
+        }
+        if (value_type == TYPE_STRING || value_type == TYPE_BOOLEAN) {
+            output_puts(out, "fputs(");
+            emit_expr(gen, value, value_type == TYPE_BOOLEAN ? PREC_OR : PREC_ASSIGN);
+            if (value_type == TYPE_BOOLEAN) output_puts(out, " ? \"true\" : \"false\"");
+            output_puts(out, ", stdout);");
+            return;
+        }
+    }
+
+    output_puts(out, "printf(\"");
+    bool open_escape = false;
+    for (const Stmt *stmt = first;; stmt = stmt->next) {
+        for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) {
+            if (is_format_literal(arg)) {
+                emit_literal_text(out, arg, true, &open_escape);
+                continue;
+            }
+            open_escape = false;
+            switch (expr_type(arg)->kind) {
+            case TYPE_STRING:
+            case TYPE_BOOLEAN: output_write(out, "%s", 2); break;
+            case TYPE_CHAR: output_write(out, "%c", 2); break;
+            default: output_write(out, "%d", 2); break;
+            }
+        }
+        if (stmt == last) break;
+    }
+    output_write(out, "\"", 1);
+    for (const Stmt *stmt = first;; stmt = stmt->next) {
+        for (const Expr *arg = stmt->expr; arg != NULL; arg = arg->next) {
+            if (is_format_literal(arg)) continue;
+            output_write(out, ", ", 2);
+            if (expr_type(arg)->kind == TYPE_BOOLEAN) {
+                // Booleans print as true/false
+                emit_expr(gen, arg, PREC_OR);
+                output_puts(out, " ? \"true\" : \"false\"");
+            } else {
+                emit_expr(gen, arg, PREC_ASSIGN);
+            }
+        }
+        if (stmt == last) break;
+    }
+    output_write(out, ");", 2);
+}
+
+// i = i + 1 is written as i++
+static bool is_increment_by_one(const Expr *expr) {
+    if (expr == NULL || expr->kind != EXPR_ASSIGN || expr->left->kind != EXPR_NAME) return false;
+    const Expr *sum = expr->right;
+    return sum->kind == EXPR_BINARY && sum->op == TOKEN_PLUS && sum->left->kind == EXPR_NAME &&
+           sum->left->name_id == expr->left->name_id &&
+           sum->right->kind == EXPR_INTEGER_LITERAL && sum->right->value == 1;
+}
+
+static bool is_index_expr(const Expr *expr) {
+    return expr->kind == EXPR_INDEX;
+}
+
+// Smallest literal loop bound worth splitting across threads (--parallel)
+#define PARALLEL_MIN_ITERATIONS 4096
+
+// Most variables a vectorizable loop body may declare or sum into
+#define LANE_LOOP_MAX_SCALARS 16
+
+// What a loop has to satisfy to be marked for vectorization
+typedef struct {
+    const Symbol *index;        // Loop variable
+    const Symbol *bound;        // Variable the index is compared with, if any
+    const Symbol *inner[LANE_LOOP_MAX_SCALARS];     // Declared in the body; private to an iteration
+    int inner_count;
+    const Expr *sums[LANE_LOOP_MAX_SCALARS];        // Outer variables updated only by s = s + e
+    int sum_count;
+    bool indexes_array;
+} LaneLoop;
+
+// Whether an expression only computes with scalars and with elements a[i]
+// of arrays, where i is the loop variable
+static bool is_lane_expr(const Expr *expr, const Symbol *index) {
+    switch (expr->kind) {
+    case EXPR_NAME:
+        return expr->symbol != NULL && expr->symbol->type->kind != TYPE_ARRAY &&
+               expr->symbol->type->kind != TYPE_FUNCTION;
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_BOOLEAN_LITERAL:
+    case EXPR_CHAR_LITERAL:
+        return true;
+    case EXPR_INDEX:
+        return expr->left->kind == EXPR_NAME && expr->right->kind == EXPR_NAME && expr->right->symbol == index;
+    case EXPR_UNARY:
+        return is_lane_expr(expr->left, index);
+    case EXPR_BINARY:
+        if (expr->op == TOKEN_CARET && classify_power(expr) >= POWER_HELPER) return false;
+        return is_lane_expr(expr->left, index) && is_lane_expr(expr->right, index);
+    default:
+        return false;
+    }
+}
+
+static int count_reads(const Expr *expr, const Symbol *symbol) {
+    switch (expr->kind) {
+    case EXPR_NAME:
+        return expr->symbol == symbol;
+    case EXPR_INDEX:
+    case EXPR_BINARY:
+        return count_reads(expr->left, symbol) + count_reads(expr->right, symbol);
+    case EXPR_UNARY:
+        return count_reads(expr->left, symbol);
+    default:
+        return 0;
+    }
+}
+
+static bool is_inner_scalar(const LaneLoop *loop, const Symbol *symbol) {
+    for (int i = 0; i < loop->inner_count; i++) {
+        if (loop->inner[i] == symbol) return true;
+    }
+    return false;
+}
+
+// Every statement of a loop body stores an is_lane_expr() value to an
+// element a[i], to a variable declared in the body, or adds it to an outer
+// variable that nothing else in the body reads
+static bool is_lane_body(LaneLoop *loop, const Stmt *stmt) {
+    for (; stmt != NULL; stmt = stmt->next) {
+        if (stmt->kind == STMT_BLOCK) {
+            if (!is_lane_body(loop, stmt->body)) return false;
+            continue;
+        }
+        if (stmt->kind == STMT_DECL) {
+            const Decl *decl = stmt->decl;
+            if (decl->type->kind == TYPE_ARRAY || decl->type->kind == TYPE_FUNCTION || decl->value == NULL ||
+                !is_lane_expr(decl->value, loop->index) || loop->inner_count == LANE_LOOP_MAX_SCALARS) {
+                return false;
+            }
+            loop->inner[loop->inner_count++] = decl->symbol;
+            continue;
+        }
+        if (stmt->kind != STMT_EXPR || stmt->expr->kind != EXPR_ASSIGN) return false;
+        const Expr *target = stmt->expr->left;
+        const Expr *value = stmt->expr->right;
+        if (!is_lane_expr(value, loop->index)) return false;
+        if (target->kind == EXPR_INDEX) {
+            if (!is_lane_expr(target, loop->index)) return false;
+            loop->indexes_array = true;
+            continue;
+        }
+        const Symbol *symbol = target->kind == EXPR_NAME ? target->symbol : NULL;
+        if (symbol == NULL || symbol->type->kind == TYPE_ARRAY) return false;
+        if (!is_inner_scalar(loop, symbol)) {
+            bool is_sum = value->kind == EXPR_BINARY && value->op == TOKEN_PLUS && value->left->kind == EXPR_NAME &&
+                          value->left->symbol == symbol && count_reads(value->right, symbol) == 0;
+            if (!is_sum || symbol->kind == SYMBOL_GLOBAL || symbol == loop->index || symbol == loop->bound ||
+                loop->sum_count == LANE_LOOP_MAX_SCALARS) {
+                return false;
+            }
+            loop->sums[loop->sum_count++] = target;
+        }
+        if (expr_any(value, is_index_expr)) loop->indexes_array = true;
+    }
+    return true;
+}
+
+static int count_body_reads(const Stmt *stmt, const Symbol *symbol) {
+    int reads = 0;
+    for (; stmt != NULL; stmt = stmt->next) {
+        if (stmt->kind == STMT_BLOCK) reads += count_body_reads(stmt->body, symbol);
+        else if (stmt->kind == STMT_DECL) reads += count_reads(stmt->decl->value, symbol);
+        else reads += count_reads(stmt->expr->left, symbol) * (stmt->expr->left->kind == EXPR_INDEX) +
+                      count_reads(stmt->expr->right, symbol);
+    }
+    return reads;
+}
+
+// A counted loop over arrays: i from a start value while i < n or i <= n,
+// stepping by one, where n is a literal or a variable the body does not
+// change, and every array access in the body is a[i]. Iterations then touch
+// different elements even if two of the arrays are the same one, so the
+// loop is vectorizable with the outer sums as reductions.
+static bool is_lane_loop(const Stmt *stmt, LaneLoop *loop) {
+    const Expr *step = stmt->step;
+    const Expr *condition = stmt->expr;
+    if (step == NULL || condition == NULL) return false;
+    const Expr *variable = step->kind == EXPR_POSTFIX && step->op == TOKEN_INCREMENT ? step->left
+                           : is_increment_by_one(step) ? step->left : NULL;
+    if (variable == NULL || variable->kind != EXPR_NAME || variable->symbol == NULL) return false;
+    memset(loop, 0, sizeof(*loop));
+    loop->index = variable->symbol;
+    if (loop->index->kind == SYMBOL_GLOBAL || loop->index->type->kind != TYPE_INTEGER) return false;
+    bool initialized = stmt->decl != NULL ? stmt->decl->symbol == loop->index && stmt->decl->value != NULL
+                                          : stmt->init != NULL && stmt->init->kind == EXPR_ASSIGN &&
+                                            stmt->init->left->kind == EXPR_NAME && stmt->init->left->symbol == loop->index;
+    if (!initialized || condition->kind != EXPR_BINARY ||
+        (condition->op != TOKEN_LESS && condition->op != TOKEN_LESS_EQUAL) ||
+        condition->left->kind != EXPR_NAME || condition->left->symbol != loop->index) {
+        return false;
+    }
+    const Expr *limit = condition->right;
+    if (limit->kind != EXPR_INTEGER_LITERAL && (limit->kind != EXPR_NAME || !is_lane_expr(limit, loop->index))) {
+        return false;
+    }
+    if (limit->kind == EXPR_NAME) loop->bound = limit->symbol;
+    if (stmt->body == NULL) return false;
+    const Stmt *body = stmt->body->kind == STMT_BLOCK ? stmt->body->body : stmt->body;
+    if (!is_lane_body(loop, body) || !loop->indexes_array) return false;
+    for (int i = 0; i < loop->sum_count; i++) {
+        if (count_body_reads(body, loop->sums[i]->symbol) != 1) return false;
+    }
+    return true;
+}
+
+// `#pragma omp simd` asserts what is_lane_loop() checked, and makes gcc
+// vectorize the loop even at -O2 when built with -fopenmp. It sits inside
+// #ifdef _OPENMP so that builds without OpenMP stay free of
+// -Wunknown-pragmas warnings. With --parallel the iterations are also split
+// across threads, unless the bound is a literal too small to pay for
+// starting them. A loop variable declared before the loop keeps its final
+// value through lastprivate.
+static void emit_lane_pragma(CodeGen *gen, const Stmt *stmt, const LaneLoop *loop) {
+    OutputBuffer *out = gen->out;
+    const Expr *limit = stmt->expr->right;
+    output_puts(out, "#ifdef _OPENMP\n");
+    output_indent(out, gen->indent);
+    if (gen->parallel && (limit->kind != EXPR_INTEGER_LITERAL || limit->value >= PARALLEL_MIN_ITERATIONS)) {
+        output_puts(out, "#pragma omp parallel for simd");
+        if (stmt->decl == NULL) output_printf(out, " lastprivate(%.*s)", stmt->init->left->length, stmt->init->left->text);
+    } else {
+        output_puts(out, "#pragma omp simd");
+    }
+    for (int i = 0; i < loop->sum_count; i++) {
+        output_printf(out, "%s%.*s", i == 0 ? " reduction(+:" : ", ", loop->sums[i]->length, loop->sums[i]->text);
+    }
+    if (gen->profile_loop != NULL) {
+        // The iteration count of --profile is one more sum
+        output_printf(out, "%sbminor_loop_iterations_%d", loop->sum_count == 0 ? " reduction(+:" : ", ",
+                      gen->profile_loop->site);
+    }
+    output_puts(out, loop->sum_count > 0 || gen->profile_loop != NULL ? ")\n" : "\n");
+    output_indent(out, gen->indent);
+    output_puts(out, "#endif\n");
+    output_indent(out, gen->indent);
+}
+
+// --profile hooks. Each function and loop gets a static site tagged with its
+// Bminor function and line; the runtime in the prelude adds a site to its
+// report the first time it is entered. Only the outermost activation of a
+// site is timed, so recursion is not counted twice.
+
+static void emit_profile_loop_leave(CodeGen *gen, int site) {
+    output_printf(gen->out, "bminor_profile_leave(&bminor_loop_site_%d, bminor_loop_start_%d, bminor_loop_iterations_%d);\n",
+                  site, site, site);
+}
+
+// Stop the timers of the loops a return leaves and of the function. The
+// first line's indentation may already have been written. Returns whether
+// anything was written.
+static bool emit_profile_leaves(CodeGen *gen, bool indented) {
+    if (!gen->profile || !gen->in_function_body) return false;
+    for (const ProfileLoop *loop = gen->profile_loop; loop != NULL; loop = loop->outer) {
+        if (!indented) output_indent(gen->out, gen->indent);
+        emit_profile_loop_leave(gen, loop->site);
+        indented = false;
+    }
+    if (!indented) output_indent(gen->out, gen->indent);
+    output_puts(gen->out, "bminor_profile_leave(&bminor_function_site, bminor_function_start, 0);\n");
+    return true;
+}
+
+// Site, timer and iteration count of a loop, on the lines before it
+static void emit_profile_loop_start(CodeGen *gen, const Stmt *stmt, int site) {
+    OutputBuffer *out = gen->out;
+    output_printf(out, "static BminorProfileSite bminor_loop_site_%d = { .function = \"%.*s\", .line = %d, .loop = true };\n",
+                  site, gen->function->name_length, gen->function->name, stmt->line);
+    output_indent(out, gen->indent);
+    output_printf(out, "unsigned long long bminor_loop_start_%d = bminor_profile_enter(&bminor_loop_site_%d);\n", site, site);
+    output_indent(out, gen->indent);
+    output_printf(out, "unsigned long long bminor_loop_iterations_%d = 0;\n", site);
+    output_indent(out, gen->indent);
+}
+
+// Emit a statement, or a run of prints starting with it; returns the last
+// statement emitted
+static const Stmt *emit_stmt(CodeGen *gen, const Stmt *stmt) {
+    OutputBuffer *out = gen->out;
+    const Stmt *last = stmt;
+    emit_comments(gen, stmt->comments);
+    if (stmt->blank_before) output_write(out, "\n", 1);
+
+    if (stmt->kind == STMT_UNHANDLED) {
+        // One comment line per source line, without the original indentation
+        const char *text = stmt->text;
+        const char *end = stmt->text + stmt->text_length;
+        while (text < end) {
+            while (text < end && isspace((unsigned char)*text)) text++;
+            const char *line_end = memchr(text, '\n', (size_t)(end - text));
+            if (line_end == NULL) line_end = end;
+            output_indent(out, gen->indent);
+            output_printf(out, "// Unhandled Bminor statement: %.*s\n", (int)(line_end - text), text);
+            text = line_end + 1;
+        }
+        return stmt;
+    }
+
+    output_indent(out, gen->indent);
+    switch (stmt->kind) {
+    case STMT_DECL:
+        emit_variable(gen, stmt->decl);
+        break;
+    case STMT_EXPR:
+        emit_expr(gen, stmt->expr, PREC_ASSIGN);
+        output_write(out, ";", 1);
+        break;
+    case STMT_PRINT:
+        last = print_run_end(stmt);
+        emit_print(gen, stmt, last);
+        break;
+    case STMT_RETURN:
+        if (stmt->expr != NULL && ((gen->live_count > 0 && expr_any(stmt->expr, uses_live_array)) ||
+                                   (gen->profile && expr_any(stmt->expr, has_side_effects)))) {
+            // The value still reads an array that is about to be freed, or
+            // makes calls that belong to the function's time
+            output_printf(out, "{\n");
+            gen->indent++;
+            output_indent(out, gen->indent);
+            output_printf(out, "%s bminor_result = ", gen->return_type);
+            emit_expr(gen, stmt->expr, PREC_ASSIGN);
+            output_puts(out, ";\n");
+            emit_frees(gen, 0, false);
+            emit_profile_leaves(gen, false);
+            output_indent(out, gen->indent);
+            output_puts(out, "return bminor_result;\n");
+            gen->indent--;
+            output_indent(out, gen->indent);
+            output_write(out, "}", 1);
+            break;
+        }
+        emit_frees(gen, 0, true);
+        if (emit_profile_leaves(gen, gen->live_count == 0) || gen->live_count > 0) output_indent(out, gen->indent);
+        if (stmt->expr != NULL) {
+            output_puts(out, "return ");
+            emit_expr(gen, stmt->expr, PREC_ASSIGN);
+            output_write(out, ";", 1);
+        } else {
+            output_puts(out, "return;");
+        }
+        break;
+    case STMT_IF:
+        output_puts(out, "if (");
+        emit_expr(gen, stmt->expr, PREC_ASSIGN);
+        output_puts(out, ") {\n");
+        emit_block_contents(gen, stmt->body);
+        while (stmt->else_body != NULL) {
+            const Stmt *else_body = stmt->else_body;
+            if (else_body->kind == STMT_IF && else_body->comments == NULL && else_body->next == NULL) {
+                // else if chains stay flat
+                output_puts(out, " else if (");
+                emit_expr(gen, else_body->expr, PREC_ASSIGN);
+                output_puts(out, ") {\n");
+                emit_block_contents(gen, else_body->body);
+                stmt = else_body;
+            } else {
+                output_puts(out, " else {\n");
+                emit_block_contents(gen, else_body);
+                break;
+            }
+        }
+        break;
+    case STMT_FOR: {
+        // A loop variable declared in the header stays local to the loop
+        const Decl *decl = stmt->decl;
+        LaneLoop loop;
+        ProfileLoop timed = { gen->profile_loop_count, gen->profile_loop };
+        if (gen->profile && gen->in_function_body) {
+            gen->profile_loop_count++;
+            emit_profile_loop_start(gen, stmt, timed.site);
+            gen->profile_loop = &timed;
+        }
+        if (is_lane_loop(stmt, &loop)) emit_lane_pragma(gen, stmt, &loop);
+        output_puts(out, "for (");
+        if (decl != NULL) {
+            output_printf(out, "%s %.*s", c_type_name(decl->type), decl->name_length, decl->name);
+            if (decl->value != NULL) {
+                output_write(out, " = ", 3);
+                emit_expr(gen, decl->value, PREC_ASSIGN);
+            }
+        } else if (stmt->init != NULL) {
+            emit_expr(gen, stmt->init, PREC_ASSIGN);
+        }
+        output_write(out, "; ", 2);
+        if (stmt->expr != NULL) emit_expr(gen, stmt->expr, PREC_ASSIGN);
+        output_write(out, "; ", 2);
+        if (is_increment_by_one(stmt->step)) {
+            output_printf(out, "%.*s++", stmt->step->left->length, stmt->step->left->text);
+        } else if (stmt->step != NULL) {
+            emit_expr(gen, stmt->step, PREC_ASSIGN);
+        }
+        output_puts(out, ") {\n");
+        if (gen->profile_loop == &timed) {
+            output_indent(out, gen->indent + 1);
+            output_printf(out, "bminor_loop_iterations_%d++;\n", timed.site);
+        }
+        emit_block_contents(gen, stmt->body);
+        if (gen->profile_loop == &timed) {
+            gen->profile_loop = timed.outer;
+            emit_line_end(gen, last);
+            output_indent(out, gen->indent);
+            emit_profile_loop_leave(gen, timed.site);
+            return last;
+        }
+        break;
+    }
+    case STMT_BLOCK:
+        output_puts(out, "{\n");
+        emit_block_contents(gen, stmt);
+        break;
+    case STMT_UNHANDLED:
+        break;
+    }
+    emit_line_end(gen, last);
+    return last;
+}
+
+static bool decl_is_main(const Decl *decl) {
+    return decl->name_length == 4 && memcmp(decl->name, "main", 4) == 0;
+}
+
+static void emit_signature(CodeGen *gen, const Decl *decl) {
+    const char *return_type = c_type_name(decl->type->subtype);
+    if (decl_is_main(decl)) {
+        output_printf(gen->out, "%s main()", return_type); // Simplified main signature
+    } else {
+        output_printf(gen->out, "%s %.*s(", return_type, decl->name_length, decl->name);
+        emit_params(gen, decl->type->params);
+        output_write(gen->out, ")", 1);
+    }
+}
+
+static void emit_function(CodeGen *gen, const Stmt *item) {
+    OutputBuffer *out = gen->out;
+    const Decl *decl = item->decl;
+    const char *return_type = c_type_name(decl->type->subtype);
+
+    emit_signature(gen, decl);
+    if (decl->body == NULL) {
+        output_write(out, ";", 1);
+        emit_line_end(gen, item);
+        return;
+    }
+    output_puts(out, " {\n");
+
+    gen->in_function_body = true;
+    gen->return_type = return_type;
+    gen->function = decl;
+    gen->profile_loop_count = 0;
+    stmt_any_expr(decl->body->body, count_array_use);
+    if (decl_is_main(decl) && gen->buffered_output) {
+        // Output is written when the buffer fills and when main returns
+        output_puts(out, "    static char bminor_stdout_buffer[1 << 20];\n");
+        output_puts(out, "    setvbuf(stdout, bminor_stdout_buffer, _IOFBF, sizeof(bminor_stdout_buffer));\n");
+    }
+    if (gen->profile) {
+        // The report is written when the program exits
+        if (decl_is_main(decl)) output_puts(out, "    bminor_profile_begin();\n");
+        output_printf(out, "    static BminorProfileSite bminor_function_site = { .function = \"%.*s\", .line = %d };\n",
+                      decl->name_length, decl->name, decl->line);
+        output_puts(out, "    unsigned long long bminor_function_start = bminor_profile_enter(&bminor_function_site);\n");
+    }
+    if (decl_is_main(decl)) {
+        // Globals that need a heap allocation get it before anything else
+        // runs, and are freed when main returns
+        for (int i = 0; i < gen->global_array_count; i++) {
+            const HeapArray *array = &gen->global_arrays[i];
+            output_printf(out, "    bminor_allocate_%.*s();\n", array->length, array->name);
+            push_live_array(gen, array->name, array->length, array->symbol);
+        }
+    }
+    gen->indent++;
+    const Stmt *last = NULL;
+    for (const Stmt *stmt = decl->body->body; stmt != NULL; stmt = stmt->next) stmt = last = emit_stmt(gen, stmt);
+    emit_comments(gen, decl->body->closing_comments);
+    bool reachable = last == NULL || last->kind != STMT_RETURN;
+    close_live_arrays(gen, 0, reachable);
+    if (reachable) emit_profile_leaves(gen, false);
+    gen->indent--;
+    gen->in_function_body = false;
+    output_write(out, "}", 1);
+    emit_line_end(gen, item);
+}
+
+static bool uses_power_helper(const Expr *expr) {
+    return expr->kind == EXPR_BINARY && expr->op == TOKEN_CARET && classify_power(expr) == POWER_HELPER;
+}
+
+static bool uses_libm(const Expr *expr) {
+    return expr->kind == EXPR_BINARY && expr->op == TOKEN_CARET && classify_power(expr) == POWER_LIBM;
+}
+
+static bool uses_new_array(const Expr *expr) {
+    return expr->kind == EXPR_NEW_ARRAY;
+}
+
+static bool uses_boolean_literal(const Expr *expr) {
+    return expr->kind == EXPR_BOOLEAN_LITERAL;
+}
+
+// What generated C can need from the prelude, as bits
+enum {
+    NEEDS_STDIO = 1 << 0,
+    NEEDS_STDLIB = 1 << 1,
+    NEEDS_STDBOOL = 1 << 2,
+    NEEDS_MATH = 1 << 3,
+    NEEDS_POWER_HELPER = 1 << 4,
+    NEEDS_PROFILE_RUNTIME = 1 << 5
+};
+
+static bool type_uses_bool(const Type *type) {
+    if (type == NULL) return false;
+    if (type->kind == TYPE_BOOLEAN) return true;
+    for (const Param *param = type->params; param != NULL; param = param->next) {
+        if (type_uses_bool(param->type)) return true;
+    }
+    return type_uses_bool(type->subtype);
+}
+
+// Needs of statements: prints and boolean declarations, at any depth
+static unsigned stmt_needs(const Stmt *stmt) {
+    unsigned needs = 0;
+    for (; stmt != NULL; stmt = stmt->next) {
+        if (stmt->kind == STMT_PRINT) needs |= NEEDS_STDIO;
+        if (stmt->decl != NULL) {
+            if (type_uses_bool(stmt->decl->type)) needs |= NEEDS_STDBOOL;
+            needs |= stmt_needs(stmt->decl->body);
+        }
+        needs |= stmt_needs(stmt->body) | stmt_needs(stmt->else_body);
+    }
+    return needs;
+}
+
+// Headers and helpers (NEEDS_*) the C of a list of top-level items uses
+static unsigned items_needs(const Stmt *items, bool buffered_output) {
+    unsigned needs = stmt_needs(items);
+    for (const Stmt *item = items; item != NULL; item = item->next) {
+        if (item->kind != STMT_DECL) continue;
+        // Allocating a global reports failure with fprintf() and exit()
+        if (is_allocated_global(item->decl)) needs |= NEEDS_STDIO | NEEDS_STDLIB;
+        if (buffered_output && item->decl->type->kind == TYPE_FUNCTION && decl_is_main(item->decl)) needs |= NEEDS_STDIO;
+    }
+    if (stmt_any_expr(items, uses_new_array)) needs |= NEEDS_STDLIB;
+    if (stmt_any_expr(items, uses_boolean_literal)) needs |= NEEDS_STDBOOL;
+    if (stmt_any_expr(items, uses_libm)) needs |= NEEDS_MATH;
+    if (stmt_any_expr(items, uses_power_helper)) needs |= NEEDS_POWER_HELPER;
+    return needs;
+}
+
+// Integer exponentiation by squaring, emitted once some ^ needs it
+static void emit_power_helper(CodeGen *gen) {
+    output_puts(gen->out,
+        "// Integer exponentiation by squaring for Bminor's ^\n"
+        "static inline int bminor_ipow(int base, int exponent) {\n"
+        "    if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;\n"
+        "    unsigned result = 1, factor = (unsigned)base;\n"
+        "    for (; exponent > 0; exponent >>= 1) {\n"
+        "        if (exponent & 1) result *= factor;\n"
+        "        factor *= factor;\n"
+        "    }\n"
+        "    return (int)result;\n"
+        "}\n\n");
+}
+
+// Runtime of --profile. Times are read from the time stamp counter where
+// there is one, and converted to seconds against the clock when the report
+// is written at exit.
+static void emit_profile_runtime(CodeGen *gen) {
+    output_puts(gen->out,
+        "// Call counts, iteration counts and times per Bminor function and loop (--profile)\n"
+        "#include <time.h>\n"
+        "#if defined(__x86_64__) && defined(__GNUC__)\n"
+        "#include <x86intrin.h>\n"
+        "#define bminor_profile_ticks() __rdtsc()\n"
+        "#else\n"
+        "#define bminor_profile_ticks() ((unsigned long long)(bminor_profile_seconds() * 1e9))\n"
+        "#endif\n"
+        "\n"
+        "typedef struct BminorProfileSite {\n"
+        "    const char *function;\n"
+        "    int line;\n"
+        "    bool loop;\n"
+        "    int depth;                       // Activations in progress; only the outermost is timed\n"
+        "    unsigned long long entries;      // Calls of a function, runs of a loop\n"
+        "    unsigned long long iterations;\n"
+        "    unsigned long long ticks;\n"
+        "    struct BminorProfileSite *next;\n"
+        "} BminorProfileSite;\n"
+        "\n"
+        "static BminorProfileSite *bminor_profile_sites;\n"
+        "static unsigned long long bminor_profile_begin_ticks;\n"
+        "static double bminor_profile_begin_seconds;\n"
+        "\n"
+        "static double bminor_profile_seconds(void) {\n"
+        "    struct timespec now;\n"
+        "    clock_gettime(CLOCK_MONOTONIC, &now);\n"
+        "    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;\n"
+        "}\n"
+        "\n"
+        "static inline unsigned long long bminor_profile_enter(BminorProfileSite *site) {\n"
+        "    if (site->entries++ == 0) {\n"
+        "        site->next = bminor_profile_sites;\n"
+        "        bminor_profile_sites = site;\n"
+        "    }\n"
+        "    return site->depth++ == 0 ? bminor_profile_ticks() : 0;\n"
+        "}\n"
+        "\n"
+        "static inline void bminor_profile_leave(BminorProfileSite *site, unsigned long long start,\n"
+        "                                        unsigned long long iterations) {\n"
+        "    site->iterations += iterations;\n"
+        "    if (--site->depth == 0) site->ticks += bminor_profile_ticks() - start;\n"
+        "}\n"
+        "\n"
+        "static int bminor_profile_compare(const void *a, const void *b) {\n"
+        "    const BminorProfileSite *x = *(BminorProfileSite *const *)a, *y = *(BminorProfileSite *const *)b;\n"
+        "    return x->ticks < y->ticks ? 1 : x->ticks > y->ticks ? -1 : x->line - y->line;\n"
+        "}\n"
+        "\n"
+        "// Every site that was entered, most time first, on stderr\n"
+        "static void bminor_profile_report(void) {\n"
+        "    double seconds = bminor_profile_seconds() - bminor_profile_begin_seconds;\n"
+        "    unsigned long long ticks = bminor_profile_ticks() - bminor_profile_begin_ticks;\n"
+        "    double seconds_per_tick = ticks > 0 ? seconds / (double)ticks : 0;\n"
+        "    size_t count = 0;\n"
+        "    for (BminorProfileSite *site = bminor_profile_sites; site != NULL; site = site->next) count++;\n"
+        "    BminorProfileSite **sorted = malloc((count + 1) * sizeof(*sorted));\n"
+        "    if (sorted == NULL) return;\n"
+        "    count = 0;\n"
+        "    for (BminorProfileSite *site = bminor_profile_sites; site != NULL; site = site->next) sorted[count++] = site;\n"
+        "    qsort(sorted, count, sizeof(*sorted), bminor_profile_compare);\n"
+        "    fprintf(stderr, \"%12s %7s %14s %16s  %s\\n\", \"seconds\", \"%\", \"calls/runs\", \"iterations\", \"site\");\n"
+        "    for (size_t i = 0; i < count; i++) {\n"
+        "        const BminorProfileSite *site = sorted[i];\n"
+        "        double site_seconds = (double)site->ticks * seconds_per_tick;\n"
+        "        double share = seconds > 0 ? 100 * site_seconds / seconds : 0;\n"
+        "        fprintf(stderr, \"%12.6f %6.2f%% %14llu \", site_seconds, share, site->entries);\n"
+        "        if (site->loop) fprintf(stderr, \"%16llu  loop in %s, line %d\\n\", site->iterations, site->function, site->line);\n"
+        "        else fprintf(stderr, \"%16s  function %s, line %d\\n\", \"\", site->function, site->line);\n"
+        "    }\n"
+        "    free(sorted);\n"
+        "}\n"
+        "\n"
+        "static void bminor_profile_begin(void) {\n"
+        "    bminor_profile_begin_seconds = bminor_profile_seconds();\n"
+        "    bminor_profile_begin_ticks = bminor_profile_ticks();\n"
+        "    atexit(bminor_profile_report);\n"
+        "}\n\n");
+}
+
+// The headers and runtime support among `needs` that have not been emitted
+// yet. Only what the translated items use is included, which keeps the C
+// compiler from parsing headers for nothing.
+static void emit_prelude(CodeGen *gen, unsigned needs) {
+    OutputBuffer *out = gen->out;
+    if (gen->profile) needs |= NEEDS_PROFILE_RUNTIME | NEEDS_STDIO | NEEDS_STDLIB | NEEDS_STDBOOL;
+    needs &= ~gen->included;
+    gen->included |= needs;
+
+    if (needs & NEEDS_STDIO) output_puts(out, "#include <stdio.h>\n");
+    if (needs & NEEDS_STDLIB) output_puts(out, "#include <stdlib.h>\n"); // For malloc
+    if (needs & NEEDS_STDBOOL) output_puts(out, "#include <stdbool.h>\n"); // For bool type
+    if (needs & NEEDS_MATH) output_puts(out, "#include <math.h>\n"); // For pow() function
+    if (needs & (NEEDS_STDIO | NEEDS_STDLIB | NEEDS_STDBOOL | NEEDS_MATH)) output_write(out, "\n", 1);
+
+    if (needs & NEEDS_PROFILE_RUNTIME) emit_profile_runtime(gen);
+    if (needs & NEEDS_POWER_HELPER) emit_power_helper(gen);
+}
+
+// A top-level declaration or unhandled statement
+static void emit_item(CodeGen *gen, const Stmt *item) {
+    if (item->kind == STMT_DECL && item->decl->type->kind == TYPE_FUNCTION) {
+        emit_comments(gen, item->comments);
+        if (item->blank_before) output_write(gen->out, "\n", 1);
+        emit_function(gen, item);
+    } else {
+        emit_stmt(gen, item);
+    }
+}
+
+static void emit_program(CodeGen *gen, const Program *program) {
+    emit_prelude(gen, items_needs(program->items, gen->buffered_output));
+    for (const Stmt *item = program->items; item != NULL; item = item->next) emit_item(gen, item);
+    emit_comments(gen, program->trailing_comments);
+}
+
+// Peak resident set size of this process in KiB
+static long peak_rss_kib(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+    return usage.ru_maxrss;
+}
+
+// --stats: wall time per phase and how often each construct was translated.
+// Nothing here runs, and no clock is read, unless the flag is given.
+typedef enum {
+    PHASE_READ,
+    PHASE_PARSE,
+    PHASE_RESOLVE,
+    PHASE_FOLD,
+    PHASE_GENERATE,
+    PHASE_WRITE,
+    PHASE_COUNT
+} Phase;
+
+static const char *const phase_names[PHASE_COUNT] = { "read", "parse", "resolve", "fold", "generate", "write" };
+
+// The power counters are in PowerForm order
+typedef enum {
+    COUNT_FUNCTIONS,
+    COUNT_GLOBALS,
+    COUNT_ARRAYS,
+    COUNT_PRINTS,
+    COUNT_IFS,
+    COUNT_FORS,
+    COUNT_LOGICAL,
+    COUNT_POWER_ONE,
+    COUNT_POWER_BASE,
+    COUNT_POWER_PRODUCT,
+    COUNT_POWER_SHIFT,
+    COUNT_POWER_HELPER,
+    COUNT_POWER_LIBM,
+    COUNT_UNHANDLED,
+    COUNTER_COUNT
+} Counter;
+
+static const char *const counter_names[COUNTER_COUNT] = {
+    "functions", "globals", "arrays", "prints", "ifs", "fors", "logical_operators", "power_one", "power_base",
+    "power_product", "power_shift", "power_helper", "power_libm", "unhandled"
+};
+
+typedef struct {
+    double seconds[PHASE_COUNT];
+    long counts[COUNTER_COUNT];
+    size_t input_bytes;
+    size_t output_bytes;
+    size_t arena_allocations;
+    size_t arena_bytes;
+} Stats;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Charge the time since *mark to a phase and restart the clock
+static void stats_phase(Stats *stats, Phase phase, double *mark) {
+    double now = now_seconds();
+    stats->seconds[phase] += now - *mark;
+    *mark = now;
+}
+
+// Count operators in an expression, or in every element of a list
+static void stats_count_expr(Stats *stats, const Expr *expr) {
+    for (; expr != NULL; expr = expr->next) {
+        switch (expr->kind) {
+        case EXPR_BINARY:
+            if (expr->op == TOKEN_CARET) stats->counts[COUNT_POWER_ONE + classify_power(expr)]++;
+            else if (expr->op == TOKEN_AND || expr->op == TOKEN_OR) stats->counts[COUNT_LOGICAL]++;
+            stats_count_expr(stats, expr->left);
+            stats_count_expr(stats, expr->right);
+            break;
+        case EXPR_UNARY:
+            if (expr->op == TOKEN_NOT) stats->counts[COUNT_LOGICAL]++;
+            stats_count_expr(stats, expr->left);
+            break;
+        case EXPR_INDEX:
+        case EXPR_ASSIGN:
+            stats_count_expr(stats, expr->left);
+            stats_count_expr(stats, expr->right);
+            break;
+        case EXPR_CALL:
+        case EXPR_INITIALIZER:
+            stats_count_expr(stats, expr->arguments);
+            break;
+        case EXPR_NEW_ARRAY:
+        case EXPR_POSTFIX:
+            stats_count_expr(stats, expr->left);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void stats_count_stmts(Stats *stats, const Stmt *stmt, bool top_level) {
+    for (; stmt != NULL; stmt = stmt->next) {
+        switch (stmt->kind) {
+        case STMT_DECL: {
+            const Decl *decl = stmt->decl;
+            if (decl->type->kind == TYPE_FUNCTION) stats->counts[COUNT_FUNCTIONS]++;
+            else if (top_level) stats->counts[COUNT_GLOBALS]++;
+            if (decl->type->kind == TYPE_ARRAY) {
+                stats->counts[COUNT_ARRAYS]++;
+                stats_count_expr(stats, decl->type->size);
+            }
+            stats_count_expr(stats, decl->value);
+            if (decl->body != NULL) stats_count_stmts(stats, decl->body->body, false);
+            break;
+        }
+        case STMT_PRINT:
+            stats->counts[COUNT_PRINTS]++;
+            stats_count_expr(stats, stmt->expr);
+            break;
+        case STMT_IF:
+            stats->counts[COUNT_IFS]++;
+            stats_count_expr(stats, stmt->expr);
+            stats_count_stmts(stats, stmt->body, false);
+            stats_count_stmts(stats, stmt->else_body, false);
+            break;
+        case STMT_FOR:
+            stats->counts[COUNT_FORS]++;
+            if (stmt->decl != NULL) stats_count_expr(stats, stmt->decl->value);
+            stats_count_expr(stats, stmt->init);
+            stats_count_expr(stats, stmt->expr);
+            stats_count_expr(stats, stmt->step);
+            stats_count_stmts(stats, stmt->body, false);
+            break;
+        case STMT_BLOCK:
+            stats_count_stmts(stats, stmt->body, false);
+            break;
+        case STMT_EXPR:
+        case STMT_RETURN:
+            stats_count_expr(stats, stmt->expr);
+            break;
+        case STMT_UNHANDLED:
+            stats->counts[COUNT_UNHANDLED]++;
+            break;
+        }
+    }
+}
+
+static void stats_add(Stats *total, const Stats *stats) {
+    for (int i = 0; i < PHASE_COUNT; i++) total->seconds[i] += stats->seconds[i];
+    for (int i = 0; i < COUNTER_COUNT; i++) total->counts[i] += stats->counts[i];
+    total->input_bytes += stats->input_bytes;
+    total->output_bytes += stats->output_bytes;
+    total->arena_allocations += stats->arena_allocations;
+    total->arena_bytes += stats->arena_bytes;
+}
+
+// Human-readable table, or one JSON object, on standard error
+static void stats_print(const Stats *stats, bool json) {
+    double total = 0;
+    for (int i = 0; i < PHASE_COUNT; i++) total += stats->seconds[i];
+    if (json) {
+        fprintf(stderr, "{\"input_bytes\": %zu, \"output_bytes\": %zu, \"arena_allocations\": %zu, \"arena_bytes\": %zu, "
+                "\"peak_rss_kib\": %ld, \"ms\": {", stats->input_bytes, stats->output_bytes,
+                stats->arena_allocations, stats->arena_bytes, peak_rss_kib());
+        for (int i = 0; i < PHASE_COUNT; i++) fprintf(stderr, "\"%s\": %.3f, ", phase_names[i], stats->seconds[i] * 1e3);
+        fprintf(stderr, "\"total\": %.3f}, \"counts\": {", total * 1e3);
+        for (int i = 0; i < COUNTER_COUNT; i++) {
+            fprintf(stderr, "%s\"%s\": %ld", i > 0 ? ", " : "", counter_names[i], stats->counts[i]);
+        }
+        fprintf(stderr, "}}\n");
+        return;
+    }
+    fprintf(stderr, "bminor2c: %zu bytes in, %zu bytes out, %zu arena allocations (%zu bytes), peak RSS %ld KiB\n",
+            stats->input_bytes, stats->output_bytes, stats->arena_allocations, stats->arena_bytes, peak_rss_kib());
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stderr, "bminor2c: %-10s %9.3f ms %5.1f%%\n", phase_names[i], stats->seconds[i] * 1e3,
+                total > 0 ? stats->seconds[i] / total * 100 : 0);
+    }
+    fprintf(stderr, "bminor2c: %-10s %9.3f ms\n", "total", total * 1e3);
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        if (stats->counts[i] != 0) fprintf(stderr, "bminor2c: %-17s %ld\n", counter_names[i], stats->counts[i]);
+    }
+}
+
+// Split the time since *mark between generating C and writing it out
+static void stats_generated(Stats *stats, const OutputBuffer *out, double write_before, size_t flushed_before,
+                            double *mark) {
+    stats_phase(stats, PHASE_GENERATE, mark);
+    double writing = out->write_seconds - write_before;
+    stats->seconds[PHASE_GENERATE] -= writing;
+    stats->seconds[PHASE_WRITE] += writing;
+    stats->output_bytes += out->flushed - flushed_before;
+}
+
+// Translation cache (--cache DIR). The C for each top-level item is kept in
+// DIR/items.pack under a hash of the item's source, the declarations of all
+// globals (which decide how names resolve and how values print) and the
+// code generator version, so unchanged items are copied instead of translated.
+#define CACHE_PACK_MAGIC 0x4b4341504332424dULL // "MB2CPACK"
+#define CACHE_RECORD_MAGIC 0x6d657469u
+
+// Version of the C the translator generates. Bump it with every change to
+// what an item translates to, so entries from an older translator are not
+// reused; rebuilding the same source keeps the cache.
+#define CACHE_CODEGEN_VERSION 1
+
+typedef struct {
+    uint64_t magic;
+    uint32_t generation;    // Bumped by every run that opens the pack
+    uint32_t reserved;
+} CachePackHeader;
+
+// One cached item; `length` bytes of C follow, padded to 8 bytes
+typedef struct {
+    uint64_t key[2];
+    uint32_t length;
+    uint32_t flags;         // NEEDS_* of the item
+    uint32_t generation;    // Last run that used the entry, for eviction
+    uint32_t check;         // CACHE_RECORD_MAGIC ^ length, to spot torn appends
+} CacheRecord;
+
+typedef struct {
+    char *pack_path;
+    char *lock_path;        // flock()ed while the pack is created, appended to or replaced
+    size_t max_bytes;
+    int fd;
+    char *map;              // The pack as it was when opened, mapped shared
+    size_t map_length;
+    uint32_t generation;
+    CacheRecord **index;    // Open addressing on key[0]
+    size_t index_mask;
+    pthread_mutex_t lock;   // Guards the pending records
+    OutputBuffer pending;   // Records to append when the cache is closed
+    size_t pending_count;
+    atomic_size_t hits;
+    atomic_size_t misses;
+    size_t evicted;
+    size_t pack_length;     // Size of the pack after closing
+} Cache;
+
+// 128-bit hash of a byte string, eight bytes at a time
+static void hash_bytes(uint64_t hash[2], const void *data, size_t length) {
+    const unsigned char *bytes = data;
+    uint64_t a = hash[0], b = hash[1];
+    for (; length >= 8; bytes += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, bytes, 8);
+        a = (a ^ word) * 0x9e3779b97f4a7c15ULL;
+        a ^= a >> 29;
+        b = (b + word) * 0xc2b2ae3d27d4eb4fULL;
+        b ^= b >> 31;
+    }
+    uint64_t word = length;
+    memcpy(&word, bytes, length);
+    a = (a ^ word ^ (uint64_t)length << 56) * 0x9e3779b97f4a7c15ULL;
+    b = (b + word + length) * 0xc2b2ae3d27d4eb4fULL;
+    hash[0] = a ^ (b >> 32);
+    hash[1] = b ^ (a >> 29);
+}
+
+static size_t cache_record_size(uint32_t length) {
+    return sizeof(CacheRecord) + (((size_t)length + 7) & ~(size_t)7);
+}
+
+static bool cache_record_valid(const CacheRecord *record, const char *end) {
+    return record->check == (CACHE_RECORD_MAGIC ^ record->length) &&
+           (size_t)(end - (const char *)record) >= cache_record_size(record->length);
+}
+
+static void cache_index_insert(CacheRecord **index, size_t mask, CacheRecord *record) {
+    size_t slot = (size_t)record->key[0] & mask;
+    while (index[slot] != NULL) {
+        if (index[slot]->key[0] == record->key[0] && index[slot]->key[1] == record->key[1]) break;
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = record;
+}
+
+// Open or create the pack in `dir` and index its records
+static bool cache_open(Cache *cache, const char *dir, size_t max_bytes) {
+    memset(cache, 0, sizeof(*cache));
+    cache->fd = -1;
+    cache->max_bytes = max_bytes;
+    cache->pending.fd = -1;
+    pthread_mutex_init(&cache->lock, NULL);
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) return false;
+    cache->pack_path = malloc(strlen(dir) + sizeof("/items.pack"));
+    cache->lock_path = malloc(strlen(dir) + sizeof("/items.lock"));
+    if (cache->pack_path == NULL || cache->lock_path == NULL) return false;
+    sprintf(cache->pack_path, "%s/items.pack", dir);
+    sprintf(cache->lock_path, "%s/items.lock", dir);
+
+    int lock_fd = open(cache->lock_path, O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0) return false;
+    flock(lock_fd, LOCK_EX);
+    cache->fd = open(cache->pack_path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    bool ok = cache->fd >= 0 && fstat(cache->fd, &st) == 0;
+    if (ok && (size_t)st.st_size < sizeof(CachePackHeader)) {
+        // New (or truncated) pack
+        CachePackHeader header = { CACHE_PACK_MAGIC, 0, 0 };
+        ok = ftruncate(cache->fd, 0) == 0 && pwrite(cache->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+        st.st_size = sizeof(header);
+    }
+    close(lock_fd);
+    if (!ok) return false;
+
+    cache->map_length = (size_t)st.st_size;
+    void *map = mmap(NULL, cache->map_length, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+    if (map == MAP_FAILED) return false;
+    cache->map = map;
+
+    CachePackHeader *header = (CachePackHeader *)cache->map;
+    size_t count = 0;
+    const char *end = cache->map + cache->map_length;
+    char *first = cache->map + sizeof(CachePackHeader);
+    if (header->magic == CACHE_PACK_MAGIC) {
+        cache->generation = ++header->generation;
+        for (char *at = first; at + sizeof(CacheRecord) <= end; count++) {
+            const CacheRecord *record = (const CacheRecord *)at;
+            if (!cache_record_valid(record, end)) break;
+            at += cache_record_size(record->length);
+        }
+    }
+    size_t capacity = 64;
+    while (capacity < count * 2) capacity *= 2;
+    cache->index = calloc(capacity, sizeof(CacheRecord *));
+    if (cache->index == NULL) return false;
+    cache->index_mask = capacity - 1;
+    char *at = first;
+    for (size_t i = 0; i < count; i++) {
+        CacheRecord *record = (CacheRecord *)at;
+        cache_index_insert(cache->index, cache->index_mask, record);
+        at += cache_record_size(record->length);
+    }
+    return true;
+}
+
+static const CacheRecord *cache_find(Cache *cache, const uint64_t key[2]) {
+    for (size_t slot = (size_t)key[0] & cache->index_mask; cache->index[slot] != NULL;
+         slot = (slot + 1) & cache->index_mask) {
+        CacheRecord *record = cache->index[slot];
+        if (record->key[0] == key[0] && record->key[1] == key[1]) {
+            // Batch workers may mark the same record at once
+            __atomic_store_n(&record->generation, cache->generation, __ATOMIC_RELAXED);
+            atomic_fetch_add(&cache->hits, 1);
+            return record;
+        }
+    }
+    atomic_fetch_add(&cache->misses, 1);
+    return NULL;
+}
+
+static void cache_store(Cache *cache, const uint64_t key[2], uint32_t flags, const char *text, size_t length) {
+    if (length > UINT32_MAX) return;
+    CacheRecord record = { { key[0], key[1] }, (uint32_t)length, flags, cache->generation,
+                           CACHE_RECORD_MAGIC ^ (uint32_t)length };
+    static const char padding[8];
+    pthread_mutex_lock(&cache->lock);
+    output_reserve(&cache->pending, cache_record_size(record.length));
+    memcpy(cache->pending.data + cache->pending.length, &record, sizeof(record));
+    memcpy(cache->pending.data + cache->pending.length + sizeof(record), text, length);
+    memcpy(cache->pending.data + cache->pending.length + sizeof(record) + length, padding,
+           cache_record_size(record.length) - sizeof(record) - length);
+    cache->pending.length += cache_record_size(record.length);
+    cache->pending_count++;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static int compare_records_newest_first(const void *a, const void *b) {
+    uint32_t generation_a = (*(CacheRecord *const *)a)->generation;
+    uint32_t generation_b = (*(CacheRecord *const *)b)->generation;
+    return (generation_a < generation_b) - (generation_a > generation_b);
+}
+
+// Rewrite the pack with the most recently used records that fit in three
+// quarters of the size bound, so eviction does not run on every store
+static bool cache_compact(Cache *cache, const char *current, size_t current_length) {
+    size_t capacity = 64;
+    CacheRecord **records = NULL;
+    size_t count = 0;
+    const char *sources[2] = { cache->pending.data, current + sizeof(CachePackHeader) };
+    const char *ends[2] = { cache->pending.data + cache->pending.length, current + current_length };
+    for (int source = 0; source < 2; source++) {
+        for (const char *at = sources[source]; at + sizeof(CacheRecord) <= ends[source];) {
+            const CacheRecord *record = (const CacheRecord *)at;
+            if (!cache_record_valid(record, ends[source])) break;
+            if (count % 1024 == 0) records = checked_realloc(records, (count + 1024) * sizeof(CacheRecord *));
+            records[count++] = (CacheRecord *)record;
+            at += cache_record_size(record->length);
+        }
+    }
+    qsort(records, count, sizeof(CacheRecord *), compare_records_newest_first);
+
+    while (capacity < count * 2) capacity *= 2;
+    CacheRecord **kept = calloc(capacity, sizeof(CacheRecord *));
+    char *tmp_path = malloc(strlen(cache->pack_path) + 32);
+    if (kept == NULL || tmp_path == NULL) {
+        free(kept);
+        free(tmp_path);
+        free(records);
+        return false;
+    }
+    sprintf(tmp_path, "%s.%ld.tmp", cache->pack_path, (long)getpid());
+    OutputBuffer out = { NULL, 0, 0, open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644), 0, 0, false, 0, NULL, NULL };
+    CachePackHeader header = { CACHE_PACK_MAGIC, cache->generation, 0 };
+    output_write(&out, (const char *)&header, sizeof(header));
+    size_t budget = cache->max_bytes / 4 * 3;
+    size_t kept_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        CacheRecord *record = records[i];
+        size_t size = cache_record_size(record->length);
+        size_t slot = (size_t)record->key[0] & (capacity - 1);
+        bool duplicate = false;
+        for (; kept[slot] != NULL; slot = (slot + 1) & (capacity - 1)) {
+            if (kept[slot]->key[0] == record->key[0] && kept[slot]->key[1] == record->key[1]) duplicate = true;
+        }
+        if (duplicate) continue;
+        if (out.flushed + out.length + size > budget) {
+            cache->evicted++;
+            continue;
+        }
+        kept[slot] = record;
+        kept_count++;
+        output_write(&out, (const char *)record, size);
+    }
+    output_flush(&out);
+    cache->pack_length = out.flushed;
+    bool ok = out.fd >= 0 && out.error == 0 && close(out.fd) == 0 && rename(tmp_path, cache->pack_path) == 0;
+    if (!ok) unlink(tmp_path);
+    free(out.data);
+    free(kept);
+    free(tmp_path);
+    free(records);
+    return ok;
+}
+
+// Append the records stored during this run, compacting the pack instead
+// when it would outgrow the size bound
+static bool cache_close(Cache *cache) {
+    bool ok = true;
+    int lock_fd = cache->pending_count > 0 ? open(cache->lock_path, O_RDWR | O_CREAT, 0644) : -1;
+    if (lock_fd >= 0) {
+        flock(lock_fd, LOCK_EX);
+        // Another process may have appended to or replaced the pack since it was opened
+        struct stat st;
+        int fd = open(cache->pack_path, O_RDWR);
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CachePackHeader)) {
+            size_t length = (size_t)st.st_size;
+            if (length + cache->pending.length <= cache->max_bytes) {
+                ok = pwrite(fd, cache->pending.data, cache->pending.length, (off_t)length) == (ssize_t)cache->pending.length;
+                cache->pack_length = length + cache->pending.length;
+            } else {
+                void *current = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+                ok = current != MAP_FAILED && cache_compact(cache, current, length);
+                if (current != MAP_FAILED) munmap(current, length);
+            }
+        } else {
+            ok = false;
+        }
+        if (fd >= 0) close(fd);
+        close(lock_fd);
+    } else {
+        ok = cache->pending_count == 0;
+        cache->pack_length = cache->map_length;
+    }
+    if (cache->map != NULL) munmap(cache->map, cache->map_length);
+    if (cache->fd >= 0) close(cache->fd);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->pending.data);
+    free(cache->index);
+    free(cache->pack_path);
+    free(cache->lock_path);
+    return ok;
+}
+
+// Options that apply to every translation
+typedef struct {
+    bool optimize;      // -O: constant folding and dead-branch elimination
+    Cache *cache;       // --cache: reuse the C of unchanged top-level items
+    bool buffered_output; // --buffered-output: generated main gives stdout a 1 MiB buffer
+    bool parallel;      // --parallel: independent array loops become OpenMP parallel loops
+    bool profile;       // --profile: generated program reports time per function and loop
+} Options;
+
+// A top-level item as a slice of the input, ending after its last token or
+// trailing comment. Parsing the slice on its own gives the same tree as
+// parsing it in place, given the line it starts on and where the previous
+// item ended.
+typedef struct {
+    const char *start;
+    const char *end;
+    int line;
+    int previous_end_line;
+    Stmt *item;                 // Header only on a hit, fully parsed on a miss
+    const CacheRecord *cached;
+    uint64_t key[2];
+} CachedItem;
+
+// Translate through the cache: parse every item's header, look each item up,
+// and fully parse and generate only the ones that miss. Returns false
+// without writing anything when the input does not split cleanly into
+// items, in which case the caller translates it as a whole.
+static bool translate_cached(const char *source, size_t length, OutputBuffer *out, Diagnostics *diagnostics,
+                             const Options *options, Arena *arena, Stats *stats) {
+    Cache *cache = options->cache;
+    double mark = stats != NULL ? now_seconds() : 0;
+    Interner interner = { 0 };
+    OutputBuffer muted_out = { NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    Diagnostics muted = { NULL, &muted_out, 0 };
+    Parser parser;
+    parser_init(&parser, source, length, arena, &interner, &muted);
+    parser.skip_bodies = true;
+
+    // Globals decide what every item translates to, so their declarations
+    // (everything but function bodies) are part of each key
+    uint64_t context[2] = { 0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL };
+    uint32_t codegen_version = CACHE_CODEGEN_VERSION;
+    hash_bytes(context, &codegen_version, sizeof(codegen_version));
+    hash_bytes(context, &options->buffered_output, sizeof(options->buffered_output));
+    hash_bytes(context, &options->parallel, sizeof(options->parallel));
+    CachedItem *items = NULL;
+    size_t count = 0;
+    const char *start = source;
+    int line = 1;
+    int previous_end_line = 0;
+    while (!parser_check(&parser, TOKEN_EOF)) {
+        if (count % 256 == 0) items = checked_realloc(items, (count + 256) * sizeof(CachedItem));
+        CachedItem *item = &items[count++];
+        parser.skipped_body = NULL;
+        item->item = parse_item(&parser);
+        item->start = start;
+        item->line = line;
+        item->previous_end_line = previous_end_line;
+        item->end = parsed_item_end(&parser, item->item, &line);
+        item->cached = NULL;
+        previous_end_line = parser.previous_end_line;
+        start = item->end;
+        const char *header_end = parser.skipped_body != NULL ? parser.skipped_body : item->end;
+        hash_bytes(context, item->start, (size_t)(header_end - item->start));
+    }
+    Comment *trailing_comments = parser_take_comments(&parser);
+    free(muted_out.data);
+    if (muted.count > 0 || parser.error_count > 0) {
+        free(items);
+        interner_free(&interner);
+        return false;
+    }
+
+    size_t diagnostics_length = diagnostics->out->length;
+    int diagnostics_count = diagnostics->count;
+    for (size_t i = 0; i < count; i++) {
+        CachedItem *item = &items[i];
+        item->key[0] = context[0] ^ (uint64_t)(item->line - item->previous_end_line);
+        item->key[1] = context[1] ^ (uint64_t)(item->previous_end_line == 0);
+        hash_bytes(item->key, item->start, (size_t)(item->end - item->start));
+        item->cached = cache_find(cache, item->key);
+        if (item->cached != NULL) continue;
+
+        Parser item_parser;
+        parser_init_at(&item_parser, item->start, (size_t)(item->end - item->start), item->line,
+                       item->previous_end_line, arena, &interner, diagnostics);
+        item->item = parse_item(&item_parser);
+        if (!parser_check(&item_parser, TOKEN_EOF) || item_parser.pending != NULL) {
+            // The slice parsed differently on its own: take back its messages
+            diagnostics->out->length = diagnostics_length;
+            diagnostics->count = diagnostics_count;
+            free(items);
+            interner_free(&interner);
+            return false;
+        }
+    }
+
+    if (stats != NULL) stats_phase(stats, PHASE_PARSE, &mark);
+
+    // Resolve every item as one program, then cut the items apart again
+    Program program = { NULL, trailing_comments };
+    Stmt **tail = &program.items;
+    for (size_t i = 0; i < count; i++) {
+        *tail = items[i].item;
+        tail = &items[i].item->next;
+    }
+    SymbolTable symbols;
+    symbols_init(&symbols, arena, &interner, diagnostics);
+    resolve_program(&symbols, &program);
+    if (stats != NULL) stats_phase(stats, PHASE_RESOLVE, &mark);
+    unsigned needs = 0;
+    for (size_t i = 0; i < count; i++) {
+        items[i].item->next = NULL;
+        if (items[i].cached != NULL) needs |= items[i].cached->flags;
+        else needs |= items_needs(items[i].item, options->buffered_output);
+    }
+
+    // Items are only stored from programs without errors, so a hit never
+    // has messages that would need repeating
+    bool store = diagnostics->count == diagnostics_count;
+    double write_before = out->write_seconds;
+    size_t flushed_before = out->flushed;
+    CodeGen gen = { 0 };
+    gen.out = out;
+    emit_prelude(&gen, needs);
+    OutputBuffer item_out = { NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    CodeGen item_gen = { 0 };
+    item_gen.out = &item_out;
+    item_gen.buffered_output = options->buffered_output;
+    item_gen.parallel = options->parallel;
+    for (size_t i = 0; i < count; i++) {
+        const CachedItem *item = &items[i];
+        if (item->cached != NULL) {
+            if (item->item->kind == STMT_DECL) note_global_array(&item_gen, item->item->decl);
+            output_write(out, (const char *)(item->cached + 1), item->cached->length);
+            continue;
+        }
+        item_out.length = 0;
+        if (stats != NULL) stats_count_stmts(stats, item->item, true);
+        emit_item(&item_gen, item->item);
+        output_write(out, item_out.data, item_out.length);
+        if (store) {
+            cache_store(cache, item->key, items_needs(item->item, options->buffered_output), item_out.data,
+                        item_out.length);
+        }
+    }
+    emit_comments(&gen, program.trailing_comments);
+    output_flush(out);
+    if (stats != NULL) stats_generated(stats, out, write_before, flushed_before, &mark);
+    free(item_out.data);
+    codegen_free(&item_gen);
+
+    symbols_free(&symbols);
+    interner_free(&interner);
+    free(items);
+    return true;
+}
+
+// Parse and resolve a whole program, and fold it with -O. The caller frees
+// the interner and symbol table.
+static Program *analyze_program(const char *source, size_t length, Diagnostics *diagnostics, const Options *options,
+                                Arena *arena, Interner *interner, SymbolTable *symbols, Stats *stats, double *mark) {
+    Parser parser;
+    parser_init(&parser, source, length, arena, interner, diagnostics);
+    Program *program = parse_program(&parser);
+    if (stats != NULL) stats_phase(stats, PHASE_PARSE, mark);
+
+    symbols_init(symbols, arena, interner, diagnostics);
+    resolve_program(symbols, program);
+    if (stats != NULL) stats_phase(stats, PHASE_RESOLVE, mark);
+    if (options->optimize) {
+        Folder folder = { arena, 0, 0 };
+        fold_program(&folder, program);
+        if (stats != NULL) stats_phase(stats, PHASE_FOLD, mark);
+    }
+    return program;
+}
+
+// Translate one Bminor program into C. Everything the syntax tree needs is
+// allocated from `arena`, which the caller releases. All state lives here,
+// so any number of translations can run at once on different threads.
+static void translate(const char *source, size_t length, OutputBuffer *out, Diagnostics *diagnostics,
+                      const Options *options, Arena *arena, Stats *stats) {
+    out->timed = stats != NULL;
+    // Folding looks at the whole program at once, so -O bypasses the cache.
+    // So does --profile, whose hooks carry each item's absolute line.
+    if (options->cache != NULL && !options->optimize && !options->profile &&
+        translate_cached(source, length, out, diagnostics, options, arena, stats)) {
+        return;
+    }
+
+    double mark = stats != NULL ? now_seconds() : 0;
+    Interner interner = { 0 };
+    SymbolTable symbols;
+    Program *program = analyze_program(source, length, diagnostics, options, arena, &interner, &symbols, stats, &mark);
+
+    // Constructs are counted as they will be emitted, after folding; the
+    // count itself is not charged to any phase
+    double write_before = out->write_seconds;
+    size_t flushed_before = out->flushed;
+    if (stats != NULL) {
+        stats_count_stmts(stats, program->items, true);
+        mark = now_seconds();
+    }
+    CodeGen gen = { 0 };
+    gen.out = out;
+    gen.buffered_output = options->buffered_output;
+    gen.parallel = options->parallel;
+    gen.profile = options->profile;
+    emit_program(&gen, program);
+    output_flush(out);
+    if (stats != NULL) stats_generated(stats, out, write_before, flushed_before, &mark);
+    codegen_free(&gen);
+
+    symbols_free(&symbols);
+    interner_free(&interner);
+}
+
+// Library entry point (bminor2c.h): translate() with the C going to the
+// caller's sink and the messages collected for it
+Bminor2cStatus bminor2c_translate(const char *source, size_t length, const Bminor2cOptions *options,
+                                  Bminor2cSink sink, void *context, Bminor2cDiagnostics *diagnostics) {
+    Options translate_options = { false, NULL, false, false, false };
+    if (options != NULL) {
+        translate_options.optimize = options->optimize;
+        translate_options.buffered_output = options->buffered_output;
+        translate_options.parallel = options->parallel;
+        translate_options.profile = options->profile;
+    }
+    Arena arena = { 0 };
+    OutputBuffer out = { NULL, 0, 0, -1, 0, 0, false, 0, sink, context };
+    OutputBuffer messages = { NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    Diagnostics collected = { NULL, &messages, 0 };
+    translate(source, length, &out, &collected, &translate_options, &arena, NULL);
+    arena_free(&arena);
+    free(out.data);
+
+    if (diagnostics != NULL) {
+        if (messages.length > 0) {
+            output_reserve(&messages, 1);
+            messages.data[messages.length] = '\0';
+        }
+        diagnostics->text = messages.data;
+        diagnostics->length = messages.length;
+        diagnostics->count = collected.count;
+    } else {
+        free(messages.data);
+    }
+    if (out.error != 0) return BMINOR2C_SINK_FAILED;
+    return collected.count > 0 ? BMINOR2C_ERRORS : BMINOR2C_OK;
+}
+
+void bminor2c_diagnostics_free(Bminor2cDiagnostics *diagnostics) {
+    free(diagnostics->text);
+    diagnostics->text = NULL;
+    diagnostics->length = 0;
+    diagnostics->count = 0;
+}
+
+// Split output (--split N). The program is translated item by item into
+// memory as usual. main, the globals and the other items that are not
+// functions go to the first of N C files, and the functions are spread over
+// the files in source order, in runs of about equal size. Every file includes
+// one header with the includes and helpers, a prototype of each function and
+// an extern declaration of each global, so the files compile independently,
+// and in parallel under make -j. `base` is the path of the outputs without
+// an extension: base.h, base_1.c ... base_N.c.
+
+// An item of a split program and the file it goes to
+typedef struct {
+    size_t start;           // Its C within the translated text
+    size_t end;
+    int file;
+} SplitItem;
+
+static bool is_function_item(const Stmt *item) {
+    return item->kind == STMT_DECL && item->decl->type->kind == TYPE_FUNCTION;
+}
+
+// A global as the header of a split program declares it
+static void emit_extern(CodeGen *gen, const Decl *decl) {
+    OutputBuffer *out = gen->out;
+    const Type *type = decl->type;
+    if (type->kind != TYPE_ARRAY) {
+        output_printf(out, "extern %s %.*s;\n", c_type_name(type), decl->name_length, decl->name);
+    } else if (is_allocated_global(decl)) {
+        output_printf(out, "extern %s *%.*s;\n", c_type_name(type->subtype), decl->name_length, decl->name);
+    } else {
+        output_printf(out, "extern %s %.*s[];\n", c_type_name(type->subtype), decl->name_length, decl->name);
+    }
+}
+
+// Create `path` with the text of `out`; reports the failure and returns
+// false if it could not be written
+static bool write_split_file(const char *path, OutputBuffer *out) {
+    out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out->fd >= 0) {
+        output_flush(out);
+        if (close(out->fd) != 0 && out->error == 0) out->error = errno;
+    } else {
+        out->error = errno;
+    }
+    out->fd = -1;
+    out->length = 0;
+    if (out->error == 0) return true;
+    fprintf(stderr, "bminor2c: %s: %s\n", path, strerror(out->error));
+    return false;
+}
+
+static bool translate_split(const char *source, size_t length, Diagnostics *diagnostics, const Options *options,
+                            Arena *arena, const char *base, int file_count) {
+    Interner interner = { 0 };
+    SymbolTable symbols;
+    double mark = 0;
+    Program *program = analyze_program(source, length, diagnostics, options, arena, &interner, &symbols, NULL, &mark);
+
+    OutputBuffer text = { NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    CodeGen gen = { 0 };
+    gen.out = &text;
+    gen.buffered_output = options->buffered_output;
+    gen.parallel = options->parallel;
+    size_t count = 0;
+    for (const Stmt *item = program->items; item != NULL; item = item->next) count++;
+    SplitItem *items = checked_realloc(NULL, (count + 1) * sizeof(SplitItem));
+    size_t first_file_size = 0, function_size = 0;
+    size_t i = 0;
+    for (const Stmt *item = program->items; item != NULL; item = item->next, i++) {
+        items[i].start = text.length;
+        emit_item(&gen, item);
+        items[i].end = text.length;
+        bool first_file = !is_function_item(item) || decl_is_main(item->decl);
+        items[i].file = first_file ? 0 : -1;
+        if (first_file) first_file_size += items[i].end - items[i].start;
+        else function_size += items[i].end - items[i].start;
+    }
+    size_t trailing_start = text.length;
+    emit_comments(&gen, program->trailing_comments);
+
+    // Functions fill each file up to an equal share, the first file's
+    // share counting what it already has
+    size_t share = (first_file_size + function_size) / (size_t)file_count + 1;
+    size_t filled = first_file_size;
+    int file = 0;
+    i = 0;
+    for (const Stmt *item = program->items; item != NULL; item = item->next, i++) {
+        if (items[i].file == 0) continue;
+        if (filled >= share && file < file_count - 1) {
+            file++;
+            filled = 0;
+        }
+        items[i].file = file;
+        filled += items[i].end - items[i].start;
+    }
+
+    const char *name = strrchr(base, '/');
+    name = name != NULL ? name + 1 : base;
+    size_t path_size = strlen(base) + 16;
+    char *path = checked_realloc(NULL, path_size);
+    OutputBuffer out = { NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    CodeGen header = { 0 };
+    header.out = &out;
+    // The include guard is the name in upper case, e.g. BMINOR_FOO_H
+    char *guard = checked_realloc(NULL, strlen(name) + 1);
+    for (size_t c = 0; c <= strlen(name); c++) {
+        guard[c] = isalnum((unsigned char)name[c]) ? (char)toupper((unsigned char)name[c]) : name[c] ? '_' : '\0';
+    }
+    output_printf(&out, "// Declarations shared by the C files of %s\n#ifndef BMINOR_%s_H\n#define BMINOR_%s_H\n\n", name,
+                  guard, guard);
+    free(guard);
+    emit_prelude(&header, items_needs(program->items, options->buffered_output));
+    for (const Stmt *item = program->items; item != NULL; item = item->next) {
+        if (!is_function_item(item) || decl_is_main(item->decl)) continue;
+        emit_signature(&header, item->decl);
+        output_puts(&out, ";\n");
+    }
+    bool globals = false;
+    for (const Stmt *item = program->items; item != NULL; item = item->next) {
+        if (item->kind != STMT_DECL || is_function_item(item)) continue;
+        if (!globals) output_write(&out, "\n", 1);
+        globals = true;
+        emit_extern(&header, item->decl);
+    }
+    output_puts(&out, "\n#endif\n");
+    snprintf(path, path_size, "%s.h", base);
+    bool ok = write_split_file(path, &out);
+
+    for (file = 0; file < file_count && ok; file++) {
+        output_printf(&out, "#include \"%s.h\"\n", name);
+        bool separated = false;
+        i = 0;
+        for (const Stmt *item = program->items; item != NULL; item = item->next, i++) {
+            if (items[i].file != file || items[i].start == items[i].end) continue;
+            if (!separated && text.data[items[i].start] != '\n') output_write(&out, "\n", 1);
+            separated = true;
+            output_write(&out, text.data + items[i].start, items[i].end - items[i].start);
+        }
+        if (file == file_count - 1) output_write(&out, text.data + trailing_start, text.length - trailing_start);
+        snprintf(path, path_size, "%s_%d.c", base, file + 1);
+        ok = write_split_file(path, &out);
+    }
+
+    free(path);
+    free(out.data);
+    free(text.data);
+    free(items);
+    codegen_free(&gen);
+    symbols_free(&symbols);
+    interner_free(&interner);
+    return ok;
+}
+
+// Streaming translation (--stream). The input is read a window at a time and
+// each top-level item is translated and emitted as soon as the window holds
+// all of it, so memory is bounded by the largest item rather than the input.
+// What later items need to know about earlier ones (the globals' names and
+// types) is kept in a summary arena; everything else is dropped per item.
+// Names must be declared before they are used, as in the generated C.
+#define STREAM_WINDOW (1 << 20)
+
+typedef struct {
+    int fd;
+    char *data;
+    size_t start;       // First byte not yet translated
+    size_t length;
+    size_t capacity;
+    size_t total;       // Bytes read so far
+    bool at_end;
+} StreamWindow;
+
+// Keep the untranslated tail and read until the window is full or the input
+// ends, growing the window when the tail already fills it
+static bool stream_refill(StreamWindow *window) {
+    size_t tail = window->length - window->start;
+    memmove(window->data, window->data + window->start, tail);
+    window->start = 0;
+    window->length = tail;
+    if (tail + 1 >= window->capacity) {
+        window->capacity = window->capacity > 0 ? window->capacity * 2 : STREAM_WINDOW;
+        window->data = checked_realloc(window->data, window->capacity);
+    }
+    while (window->length + 1 < window->capacity) {
+        ssize_t n = read(window->fd, window->data + window->length, window->capacity - window->length - 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) {
+            window->at_end = true;
+            break;
+        }
+        window->length += (size_t)n;
+        window->total += (size_t)n;
+    }
+    window->data[window->length] = '\0';
+    return true;
+}
+
+// Global types outlive the item that declared them; only what expr_type()
+// looks at is kept
+static Type *summary_type(Arena *summary, const Type *type) {
+    if (type == NULL) return NULL;
+    Type *copy = arena_alloc(summary, sizeof(Type));
+    copy->kind = type->kind;
+    copy->subtype = summary_type(summary, type->subtype);
+    return copy;
+}
+
+// Translate the input read from fd item by item. Returns false if it could
+// not be read.
+static bool translate_stream(int fd, OutputBuffer *out, Diagnostics *diagnostics, const Options *options,
+                             Stats *stats) {
+    out->timed = stats != NULL;
+    double mark = stats != NULL ? now_seconds() : 0;
+    Arena summary = { 0 };
+    Arena arena = { 0 };
+    Interner interner = { 0 };
+    interner.copies = &summary;
+    SymbolTable symbols;
+    symbols_init(&symbols, &summary, &interner, diagnostics);
+    symbols_push_scope(&symbols);
+    CodeGen gen = { 0 };
+    gen.out = out;
+    gen.buffered_output = options->buffered_output;
+    gen.parallel = options->parallel;
+    gen.profile = options->profile;
+    emit_prelude(&gen, 0);
+
+    StreamWindow window = { fd, NULL, 0, 0, 0, 0, false };
+    int line = 1;
+    int previous_end_line = 0;
+    bool ok = true;
+    bool finished = false;
+    while (!finished) {
+        if (stats != NULL) mark = now_seconds();
+        if (!stream_refill(&window)) {
+            ok = false;
+            break;
+        }
+        if (stats != NULL) stats_phase(stats, PHASE_READ, &mark);
+        double write_before = out->write_seconds;
+        size_t flushed_before = out->flushed;
+
+        for (;;) {
+            const char *start = window.data + window.start;
+            const char *window_end = window.data + window.length;
+            size_t diagnostics_length = diagnostics->out->length;
+            int diagnostics_count = diagnostics->count;
+            arena_reset(&arena);
+            Parser parser;
+            parser_init_at(&parser, start, (size_t)(window_end - start), line, previous_end_line, &arena, &interner,
+                           diagnostics);
+            if (parser_check(&parser, TOKEN_EOF)) {
+                // Only comments are left; at the end of the input they trail the program
+                if (window.at_end) emit_comments(&gen, parser_take_comments(&parser));
+                finished = window.at_end;
+                break;
+            }
+            Stmt *item = parse_item(&parser);
+            // The item is only known to be whole if parsing it never ran into
+            // the end of the window and the rest of the line after the token
+            // that follows it has been read
+            const char *lookahead_end = parser.current.start + parser.current.length;
+            if (!window.at_end && (parser.reached_end ||
+                                   memchr(lookahead_end, '\n', (size_t)(window_end - lookahead_end)) == NULL)) {
+                diagnostics->out->length = diagnostics_length;
+                diagnostics->count = diagnostics_count;
+                break;
+            }
+            const char *end = parsed_item_end(&parser, item, &line);
+            previous_end_line = parser.previous_end_line;
+            window.start = (size_t)(end - window.data);
+            if (stats != NULL) stats_phase(stats, PHASE_PARSE, &mark);
+
+            if (item->kind == STMT_DECL) {
+                symbols.arena = &summary;
+                Decl *decl = item->decl;
+                decl->symbol = symbols_declare(&symbols, SYMBOL_GLOBAL, decl->name_id, summary_type(&summary, decl->type));
+                symbols.arena = &arena;
+                resolve_item(&symbols, item);
+            }
+            if (stats != NULL) {
+                stats_phase(stats, PHASE_RESOLVE, &mark);
+                stats_count_stmts(stats, item, true);
+                stats->arena_allocations += arena.allocation_count;
+                stats->arena_bytes += arena.bytes_used;
+                mark = now_seconds();
+            }
+
+            // What an item needs is included just before it
+            emit_prelude(&gen, items_needs(item, gen.buffered_output));
+            emit_item(&gen, item);
+            output_flush(diagnostics->out);
+            if (stats != NULL) stats_phase(stats, PHASE_GENERATE, &mark);
+        }
+        // Hand over everything translated from this window before reading on
+        output_flush(out);
+        if (stats != NULL) stats_generated(stats, out, write_before, flushed_before, &mark);
+    }
+    output_flush(out);
+    if (stats != NULL) {
+        stats->input_bytes = window.total;
+        stats->arena_allocations += summary.allocation_count;
+        stats->arena_bytes += summary.bytes_used;
+    }
+    symbols_pop_scope(&symbols);
+    symbols_free(&symbols);
+    interner_free(&interner);
+    codegen_free(&gen);
+    arena_free(&arena);
+    arena_free(&summary);
+    free(window.data);
+    return ok;
+}
+
+// Bytecode interpreter (--run). The resolved tree is compiled into
+// register-based bytecode, one function at a time, and executed in this
+// process, so a program can be run without a C compiler. Each function has a
+// frame of registers: its parameters, then its variables, then temporaries.
+// A call's arguments are evaluated into the caller's topmost registers and
+// become the callee's parameters in place. Integer results wrap around, and
+// what would be undefined in the generated C (division by zero, indexing out
+// of bounds) stops the program with an error instead.
+#define VM_STACK_SLOTS (1 << 22)
+#define VM_MAX_DEPTH (1 << 18)
+
+// Operands are register numbers unless noted
+#define VM_OPCODES(X)                                                                                    \
+    X(OP_MOVE)          /* a = b */                                                                      \
+    X(OP_LOAD_INT)      /* a = integer b */                                                              \
+    X(OP_LOAD_STRING)   /* a = string constant b */                                                      \
+    X(OP_LOAD_NULL)     /* a = no string or array */                                                     \
+    X(OP_GET_GLOBAL)    /* a = global b */                                                               \
+    X(OP_SET_GLOBAL)    /* global b = a */                                                               \
+    X(OP_ADD) X(OP_SUB) X(OP_MUL) X(OP_DIV) X(OP_MOD) X(OP_POW) /* a = b op c */                         \
+    X(OP_ADD_INT)       /* a = b + integer c */                                                          \
+    X(OP_NEG) X(OP_NOT) /* a = op b */                                                                   \
+    X(OP_EQ) X(OP_NE) X(OP_LT) X(OP_LE) X(OP_GT) X(OP_GE) /* a = b op c */                               \
+    X(OP_EQ_REF) X(OP_NE_REF) /* a = b op c, comparing strings or arrays by address */                   \
+    X(OP_JUMP)          /* skip b instructions, counted from this one */                                 \
+    X(OP_JUMP_IF_FALSE) X(OP_JUMP_IF_TRUE) /* skip b instructions if a is false / true */                \
+    X(OP_NEW_ARRAY)     /* a = array of b zeroes */                                                      \
+    X(OP_ARRAY_LIST)    /* a = array of max(a, c) elements, the first c copied from b onwards */         \
+    X(OP_INDEX)         /* a = b[c] */                                                                   \
+    X(OP_SET_INDEX)     /* a[b] = c */                                                                   \
+    X(OP_FREE_ARRAY)    /* release array a */                                                            \
+    X(OP_CALL)          /* a = function b, with the arguments in c onwards */                            \
+    X(OP_RETURN) X(OP_RETURN_VOID)                                                                       \
+    X(OP_PRINT_INT) X(OP_PRINT_BOOL) X(OP_PRINT_CHAR) X(OP_PRINT_STRING)                                 \
+    X(OP_PRINT_TEXT)    /* string constant a */
+
+#define VM_ENUM(name) name,
+typedef enum { VM_OPCODES(VM_ENUM) OP_COUNT } VmOp;
+#undef VM_ENUM
+
+typedef struct {
+    int32_t op;
+    int32_t a, b, c;
+} VmInstr;
+
+// Integers, booleans and characters use i
+typedef union {
+    int32_t i;
+    const char *s;
+    struct VmArray *array;
+} VmValue;
+
+typedef struct VmArray {
+    int32_t length;
+    VmValue items[];
+} VmArray;
+
+typedef struct {
+    VmInstr *code;
+    int *lines;             // Source line of each instruction, for runtime errors
+    int code_count;
+    int code_capacity;
+    int frame_size;         // Registers used, parameters included
+} VmFunction;
+
+typedef struct {
+    VmFunction *functions;  // [0] initializes the globals and calls main
+    int function_count;
+    VmValue *globals;
+    int global_count;
+    char **strings;         // Literals with their escapes decoded
+    size_t *string_lengths;
+    int string_count;
+} VmProgram;
+
+typedef struct {
+    VmProgram *program;
+    VmFunction *function;
+    Diagnostics *diagnostics;
+    int error_count;
+    const int *function_of_name; // Index of the function defined under each name id, 0 if none
+    int line;               // Line of the statement being compiled
+    int locals;             // Registers held by the variables in scope
+    int next_register;      // First register free for temporaries
+    int *live;              // Registers of arrays freed when their scope ends
+    int live_count;
+    int live_capacity;
+    OutputBuffer text;      // Literal text of prints, written as one constant
+} VmCompiler;
+
+static void vm_unsupported(VmCompiler *c, int line, const char *what) {
+    diagnose(c->diagnostics, line, "--run does not support %s", what);
+    c->error_count++;
+}
+
+static int vm_emit(VmCompiler *c, VmOp op, int a, int b, int operand_c) {
+    VmFunction *function = c->function;
+    if (function->code_count == function->code_capacity) {
+        function->code_capacity = function->code_capacity ? function->code_capacity * 2 : 64;
+        function->code = checked_realloc(function->code, (size_t)function->code_capacity * sizeof(VmInstr));
+        function->lines = checked_realloc(function->lines, (size_t)function->code_capacity * sizeof(int));
+    }
+    function->code[function->code_count] = (VmInstr){ op, a, b, operand_c };
+    function->lines[function->code_count] = c->line;
+    return function->code_count++;
+}
+
+// Point the jump at `at` to the next instruction emitted
+static void vm_patch(VmCompiler *c, int at) {
+    c->function->code[at].b = c->function->code_count - at;
+}
+
+static int vm_register(VmCompiler *c) {
+    int reg = c->next_register++;
+    if (c->next_register > c->function->frame_size) c->function->frame_size = c->next_register;
+    return reg;
+}
+
+static int vm_add_string(VmProgram *program, const char *text, size_t length) {
+    if (program->string_count % 64 == 0) {
+        size_t capacity = (size_t)program->string_count + 64;
+        program->strings = checked_realloc(program->strings, capacity * sizeof(char *));
+        program->string_lengths = checked_realloc(program->string_lengths, capacity * sizeof(size_t));
+    }
+    char *copy = checked_realloc(NULL, length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    program->strings[program->string_count] = copy;
+    program->string_lengths[program->string_count] = length;
+    return program->string_count++;
+}
+
+// Decode the characters between the quotes of a string or character literal
+// as C would, into room for literal->length bytes. Returns how many there are.
+static size_t vm_decode_literal(char *into, const Expr *literal) {
+    const char *text = literal->text + 1;
+    const char *end = literal->text + literal->length - 1;
+    size_t length = 0;
+    while (text < end) {
+        char ch = *text++;
+        if (ch == '\\' && text < end) {
+            ch = *text++;
+            switch (ch) {
+            case 'n': ch = '\n'; break;
+            case 't': ch = '\t'; break;
+            case 'r': ch = '\r'; break;
+            case 'a': ch = '\a'; break;
+            case 'b': ch = '\b'; break;
+            case 'f': ch = '\f'; break;
+            case 'v': ch = '\v'; break;
+            case 'x': {
+                unsigned value = 0;
+                for (; text < end && isxdigit((unsigned char)*text); text++) {
+                    value = value * 16 + (unsigned)(isdigit((unsigned char)*text) ? *text - '0'
+                                                                                   : tolower((unsigned char)*text) - 'a' + 10);
+                }
+                ch = (char)value;
+                break;
+            }
+            default:
+                if (ch >= '0' && ch <= '7') {
+                    // Up to three octal digits
+                    unsigned value = (unsigned)(ch - '0');
+                    for (int digits = 1; digits < 3 && text < end && *text >= '0' && *text <= '7'; digits++) {
+                        value = value * 8 + (unsigned)(*text++ - '0');
+                    }
+                    ch = (char)value;
+                }
+                // \\, \', \" and \? stand for the character itself
                 break;
             }
         }
-        base_start++; // Move to the actual start of the base expression
+        into[length++] = ch;
+    }
+    return length;
+}
+
+static int vm_string_constant(VmCompiler *c, const Expr *literal) {
+    char *decoded = checked_realloc(NULL, (size_t)literal->length);
+    int index = vm_add_string(c->program, decoded, vm_decode_literal(decoded, literal));
+    free(decoded);
+    return index;
+}
+
+static int vm_char_value(const Expr *literal) {
+    char decoded[8];
+    if (literal->length > (int)sizeof(decoded) || vm_decode_literal(decoded, literal) == 0) return 0;
+    return (unsigned char)decoded[0];
+}
+
+// Register of a parameter or local variable, or -1
+static int vm_local(const Expr *expr) {
+    if (expr->kind != EXPR_NAME || expr->symbol == NULL || expr->symbol->kind == SYMBOL_GLOBAL) return -1;
+    return expr->symbol->slot;
+}
+
+static void vm_expr(VmCompiler *c, const Expr *expr, int dest);
+
+// A register holding the value of expr: the variable's own register for a
+// local, otherwise a new temporary
+static int vm_operand(VmCompiler *c, const Expr *expr) {
+    int reg = vm_local(expr);
+    if (reg >= 0) return reg;
+    reg = vm_register(c);
+    vm_expr(c, expr, reg);
+    return reg;
+}
+
+// Evaluate a list into consecutive new registers; returns the first
+static int vm_expr_list(VmCompiler *c, const Expr *list, int *count) {
+    int first = c->next_register;
+    *count = 0;
+    for (const Expr *expr = list; expr != NULL; expr = expr->next) {
+        c->next_register = first + *count;
+        vm_expr(c, expr, vm_register(c));
+        (*count)++;
+    }
+    c->next_register = first + *count;
+    return first;
+}
+
+// { a, b, c } into dest, which holds the declared length
+static void vm_array_list(VmCompiler *c, const Expr *list, int dest) {
+    int count;
+    int first = vm_expr_list(c, list->arguments, &count);
+    vm_emit(c, OP_ARRAY_LIST, dest, first, count);
+}
+
+static void vm_call(VmCompiler *c, const Expr *expr, int dest) {
+    const Expr *callee = expr->left;
+    const Symbol *symbol = callee->kind == EXPR_NAME ? callee->symbol : NULL;
+    if (symbol == NULL || symbol->kind != SYMBOL_GLOBAL || symbol->type->kind != TYPE_FUNCTION) {
+        vm_unsupported(c, expr->line, "calling anything but a function by name");
+        return;
+    }
+    int function = c->function_of_name[callee->name_id];
+    if (function == 0) {
+        diagnose(c->diagnostics, expr->line, "'%.*s' is declared but never defined", callee->length, callee->text);
+        c->error_count++;
+        return;
+    }
+    int param_count = 0;
+    for (const Param *param = symbol->type->params; param != NULL; param = param->next) param_count++;
+    int count;
+    int first = vm_expr_list(c, expr->arguments, &count);
+    if (count != param_count) {
+        diagnose(c->diagnostics, expr->line, "'%.*s' takes %d arguments, not %d", callee->length, callee->text,
+                 param_count, count);
+        c->error_count++;
+    }
+    vm_emit(c, OP_CALL, dest, function, first);
+}
+
+// An assignment; dest is -1 when the value is not used
+static void vm_assign(VmCompiler *c, const Expr *expr, int dest) {
+    const Expr *target = expr->left;
+    const Expr *value = expr->right;
+    int reg = vm_local(target);
+    if (reg >= 0) {
+        // and/or and initializers write their destination before they are
+        // done reading their operands, which may include the target
+        bool early_write = value->kind == EXPR_INITIALIZER ||
+                           (value->kind == EXPR_BINARY && (value->op == TOKEN_AND || value->op == TOKEN_OR));
+        if (early_write) {
+            int temp = vm_operand(c, value);
+            vm_emit(c, OP_MOVE, reg, temp, 0);
+        } else {
+            vm_expr(c, value, reg);
+        }
+        if (dest >= 0 && dest != reg) vm_emit(c, OP_MOVE, dest, reg, 0);
+    } else if (target->kind == EXPR_NAME && target->symbol != NULL && target->symbol->type->kind != TYPE_FUNCTION) {
+        int source = dest >= 0 ? dest : vm_register(c);
+        vm_expr(c, value, source);
+        vm_emit(c, OP_SET_GLOBAL, source, target->symbol->slot, 0);
+    } else if (target->kind == EXPR_INDEX) {
+        int array = vm_operand(c, target->left);
+        int index = vm_operand(c, target->right);
+        int source = dest >= 0 ? dest : vm_register(c);
+        vm_expr(c, value, source);
+        vm_emit(c, OP_SET_INDEX, array, index, source);
+    } else {
+        vm_unsupported(c, expr->line, "this assignment target");
+    }
+}
+
+// x++ or x--; dest receives the old value unless it is -1
+static void vm_postfix(VmCompiler *c, const Expr *expr, int dest) {
+    const Expr *target = expr->left;
+    int delta = expr->op == TOKEN_INCREMENT ? 1 : -1;
+    int reg = vm_local(target);
+    if (reg >= 0) {
+        if (dest >= 0) vm_emit(c, OP_MOVE, dest, reg, 0);
+        vm_emit(c, OP_ADD_INT, reg, reg, delta);
+        return;
+    }
+    int old = dest >= 0 ? dest : vm_register(c);
+    int updated = vm_register(c);
+    if (target->kind == EXPR_NAME && target->symbol != NULL && target->symbol->type->kind != TYPE_FUNCTION) {
+        vm_emit(c, OP_GET_GLOBAL, old, target->symbol->slot, 0);
+        vm_emit(c, OP_ADD_INT, updated, old, delta);
+        vm_emit(c, OP_SET_GLOBAL, updated, target->symbol->slot, 0);
+    } else if (target->kind == EXPR_INDEX) {
+        int array = vm_operand(c, target->left);
+        int index = vm_operand(c, target->right);
+        vm_emit(c, OP_INDEX, old, array, index);
+        vm_emit(c, OP_ADD_INT, updated, old, delta);
+        vm_emit(c, OP_SET_INDEX, array, index, updated);
+    } else {
+        vm_unsupported(c, expr->line, "this increment target");
+    }
+}
 
-        // Append the part before the base to temp_buffer
-        strncat(temp_buffer, current_pos, base_start - current_pos);
+static VmOp vm_binary_op(TokenKind op, bool by_address) {
+    switch (op) {
+    case TOKEN_PLUS: return OP_ADD;
+    case TOKEN_MINUS: return OP_SUB;
+    case TOKEN_STAR: return OP_MUL;
+    case TOKEN_SLASH: return OP_DIV;
+    case TOKEN_PERCENT: return OP_MOD;
+    case TOKEN_CARET: return OP_POW;
+    case TOKEN_EQUAL: return by_address ? OP_EQ_REF : OP_EQ;
+    case TOKEN_NOT_EQUAL: return by_address ? OP_NE_REF : OP_NE;
+    case TOKEN_LESS: return OP_LT;
+    case TOKEN_LESS_EQUAL: return OP_LE;
+    case TOKEN_GREATER: return OP_GT;
+    default: return OP_GE;
+    }
+}
 
-        // Extract base
-        char base_str[128];
-        if (base_end - base_start + 1 > 0) {
-            strncpy(base_str, base_start, base_end - base_start + 1);
-            base_str[base_end - base_start + 1] = '\0';
-            trim(base_str);
+static void vm_expr(VmCompiler *c, const Expr *expr, int dest) {
+    switch (expr->kind) {
+    case EXPR_NAME: {
+        int reg = vm_local(expr);
+        if (reg >= 0) {
+            if (reg != dest) vm_emit(c, OP_MOVE, dest, reg, 0);
+        } else if (expr->symbol->type->kind == TYPE_FUNCTION) {
+            vm_unsupported(c, expr->line, "functions as values");
         } else {
-            base_str[0] = '\0'; // Handle empty base if logic fails
+            vm_emit(c, OP_GET_GLOBAL, dest, expr->symbol->slot, 0);
+        }
+        break;
+    }
+    case EXPR_INTEGER_LITERAL:
+    case EXPR_BOOLEAN_LITERAL:
+        vm_emit(c, OP_LOAD_INT, dest, (int32_t)expr->value, 0);
+        break;
+    case EXPR_CHAR_LITERAL:
+        vm_emit(c, OP_LOAD_INT, dest, vm_char_value(expr), 0);
+        break;
+    case EXPR_STRING_LITERAL:
+        vm_emit(c, OP_LOAD_STRING, dest, vm_string_constant(c, expr), 0);
+        break;
+    case EXPR_NUMBER_LITERAL:
+        vm_unsupported(c, expr->line, "real numbers");
+        break;
+    case EXPR_INITIALIZER:
+        vm_emit(c, OP_LOAD_INT, dest, 0, 0);
+        vm_array_list(c, expr, dest);
+        break;
+    case EXPR_NEW_ARRAY:
+        vm_emit(c, OP_NEW_ARRAY, dest, vm_operand(c, expr->left), 0);
+        break;
+    case EXPR_INDEX: {
+        int array = vm_operand(c, expr->left);
+        vm_emit(c, OP_INDEX, dest, array, vm_operand(c, expr->right));
+        break;
+    }
+    case EXPR_CALL:
+        vm_call(c, expr, dest);
+        break;
+    case EXPR_UNARY:
+        vm_emit(c, expr->op == TOKEN_NOT ? OP_NOT : OP_NEG, dest, vm_operand(c, expr->left), 0);
+        break;
+    case EXPR_POSTFIX:
+        vm_postfix(c, expr, dest);
+        break;
+    case EXPR_BINARY: {
+        if (expr->op == TOKEN_AND || expr->op == TOKEN_OR) {
+            vm_expr(c, expr->left, dest);
+            int jump = vm_emit(c, expr->op == TOKEN_AND ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE, dest, 0, 0);
+            vm_expr(c, expr->right, dest);
+            vm_patch(c, jump);
+            break;
         }
+        TypeKind type = expr_type(expr->left)->kind;
+        int left = vm_operand(c, expr->left);
+        int right = vm_operand(c, expr->right);
+        vm_emit(c, vm_binary_op(expr->op, type == TYPE_STRING || type == TYPE_ARRAY), dest, left, right);
+        break;
+    }
+    case EXPR_ASSIGN:
+        vm_assign(c, expr, dest);
+        break;
+    }
+}
+
+// An expression evaluated for its effect only
+static void vm_effect(VmCompiler *c, const Expr *expr) {
+    if (expr->kind == EXPR_ASSIGN) {
+        vm_assign(c, expr, -1);
+    } else if (expr->kind == EXPR_POSTFIX) {
+        vm_postfix(c, expr, -1);
+    } else {
+        vm_expr(c, expr, vm_register(c));
+    }
+}
 
+// Literal text not yet written out
+static void vm_flush_text(VmCompiler *c) {
+    if (c->text.length == 0) return;
+    vm_emit(c, OP_PRINT_TEXT, vm_add_string(c->program, c->text.data, c->text.length), 0, 0);
+    c->text.length = 0;
+}
 
-        // Find start of the exponent: go forwards from power_op_pos + 1
-        char *exp_start = power_op_pos + 1;
-        while (*exp_start != '\0' && isspace((unsigned char)*exp_start)) exp_start++; // Trim leading space
+static bool vm_is_literal(const Expr *arg) {
+    return arg->kind == EXPR_STRING_LITERAL || arg->kind == EXPR_CHAR_LITERAL || arg->kind == EXPR_INTEGER_LITERAL ||
+           arg->kind == EXPR_BOOLEAN_LITERAL;
+}
 
-        // Find end of the exponent: go forwards until non-expression character or end of string
-        char *exp_end = exp_start;
-        paren_balance = 0;
-        while (*exp_end != '\0') {
-            char c = *exp_end;
-            if (c == '(') paren_balance++;
-            else if (c == ')') paren_balance--;
+// Every argument is evaluated before anything is printed, as with the
+// printf() the statement becomes in C. Literals are collected as text, which
+// runs on into the next print statement; text of earlier prints is written
+// out before an argument is evaluated, in case that prints too.
+static void vm_print(VmCompiler *c, const Expr *args) {
+    int first = c->next_register;
+    int count = 0;
+    for (const Expr *arg = args; arg != NULL; arg = arg->next) {
+        if (vm_is_literal(arg) || vm_local(arg) >= 0) continue;
+        vm_flush_text(c);
+        c->next_register = first + count;
+        vm_expr(c, arg, vm_register(c));
+        count++;
+    }
+    c->next_register = first + count;
 
-            if (isalnum((unsigned char)c) || c == '_' || c == '.' || c == '(' || c == ')' || c == '-' || c == '+' || paren_balance > 0) {
-                exp_end++;
-            } else {
+    int next = first;
+    for (const Expr *arg = args; arg != NULL; arg = arg->next) {
+        if (arg->kind == EXPR_BOOLEAN_LITERAL) {
+            output_puts(&c->text, arg->value ? "true" : "false");
+        } else if (arg->kind == EXPR_INTEGER_LITERAL) {
+            output_printf(&c->text, "%d", (int)arg->value);
+        } else if (arg->kind == EXPR_STRING_LITERAL || arg->kind == EXPR_CHAR_LITERAL) {
+            output_reserve(&c->text, (size_t)arg->length);
+            char *decoded = c->text.data + c->text.length;
+            size_t length = vm_decode_literal(decoded, arg);
+            const char *nul = arg->kind == EXPR_STRING_LITERAL ? memchr(decoded, '\0', length) : NULL;
+            if (nul != NULL) {
+                // The C call stops writing at a NUL in its text, and so does
+                // the rest of this print
+                c->text.length += (size_t)(nul - decoded);
                 break;
             }
-        }
-        exp_end--; // Move to actual end of the exponent expression
-
-        // Extract exponent
-        char exp_str[128];
-        if (exp_end - exp_start + 1 > 0) {
-            strncpy(exp_str, exp_start, exp_end - exp_start + 1);
-            exp_str[exp_end - exp_start + 1] = '\0';
-            trim(exp_str);
+            c->text.length += length;
         } else {
-            exp_str[0] = '\0'; // Handle empty exponent
+            vm_flush_text(c);
+            int reg = vm_local(arg) >= 0 ? vm_local(arg) : next++;
+            switch (expr_type(arg)->kind) {
+            case TYPE_STRING: vm_emit(c, OP_PRINT_STRING, reg, 0, 0); break;
+            case TYPE_BOOLEAN: vm_emit(c, OP_PRINT_BOOL, reg, 0, 0); break;
+            case TYPE_CHAR: vm_emit(c, OP_PRINT_CHAR, reg, 0, 0); break;
+            default: vm_emit(c, OP_PRINT_INT, reg, 0, 0); break;
+            }
         }
+    }
+}
 
-        // Append the pow() call to temp_buffer
-        sprintf(temp_buffer + strlen(temp_buffer), "pow(%s, %s)", base_str, exp_str);
-
-        // Update current_pos to continue scanning from after the exponent
-        current_pos = exp_end + 1;
+static void vm_push_live(VmCompiler *c, int reg) {
+    if (c->live_count == c->live_capacity) {
+        c->live_capacity = c->live_capacity ? c->live_capacity * 2 : 16;
+        c->live = checked_realloc(c->live, (size_t)c->live_capacity * sizeof(int));
     }
-    // Append any remaining part of the string after the last power operator
-    strcat(temp_buffer, current_pos);
+    c->live[c->live_count++] = reg;
+}
 
-    // Copy the modified string back
-    strcpy(expr, temp_buffer);
+static void vm_free_live(VmCompiler *c, int first) {
+    for (int i = c->live_count - 1; i >= first; i--) vm_emit(c, OP_FREE_ARRAY, c->live[i], 0, 0);
 }
 
-int main() {
-    // Standard C headers needed for the translated code
-    printf("#include <stdio.h>\n");
-    printf("#include <stdlib.h>\n"); // For malloc
-    printf("#include <string.h>\n");
-    printf("#include <ctype.h>\n");
-    printf("#include <stdbool.h>\n"); // For bool type
-    printf("#include <math.h>\n\n"); // For pow() function
+// Initial value of a variable in reg. Returns true for an array that, like
+// the C array or freed allocation it becomes in the generated code, lives
+// only as long as the variable's scope.
+static bool vm_variable(VmCompiler *c, const Decl *decl, int reg) {
+    const Type *type = decl->type;
+    const Expr *value = decl->value;
+    if (type->kind != TYPE_ARRAY) {
+        if (value != NULL) {
+            vm_expr(c, value, reg);
+        } else {
+            vm_emit(c, type->kind == TYPE_STRING ? OP_LOAD_NULL : OP_LOAD_INT, reg, 0, 0);
+        }
+        return false;
+    }
+    if (value != NULL && value->kind == EXPR_NEW_ARRAY) {
+        vm_expr(c, value, reg);
+        return !array_escapes(decl->symbol);
+    }
+    if (value != NULL && value->kind != EXPR_INITIALIZER) {
+        vm_expr(c, value, reg);
+        return false;
+    }
+    if (type->size == NULL && value == NULL) {
+        vm_emit(c, OP_LOAD_NULL, reg, 0, 0);
+        return false;
+    }
+    if (type->size != NULL) {
+        vm_expr(c, type->size, reg);
+    } else {
+        vm_emit(c, OP_LOAD_INT, reg, 0, 0);
+    }
+    if (value != NULL) {
+        vm_array_list(c, value, reg);
+    } else {
+        vm_emit(c, OP_NEW_ARRAY, reg, reg, 0);
+    }
+    return true;
+}
 
-    // Declare dynamic_array globally in the generated C output
-    printf("int *dynamic_array;\n\n"); 
+static void vm_local_decl(VmCompiler *c, const Decl *decl) {
+    if (decl->type->kind == TYPE_FUNCTION) {
+        vm_unsupported(c, decl->line, "nested functions");
+        return;
+    }
+    int reg = c->locals++;
+    c->next_register = reg;
+    vm_register(c);
+    if (vm_variable(c, decl, reg)) vm_push_live(c, reg);
+    decl->symbol->slot = reg;
+}
 
-    char line[256];
-    bool in_function_body = false;
-    bool in_multiline_comment = false;
-    int brace_level = 0; // Tracks { } nesting for indentation
+static void vm_stmt(VmCompiler *c, const Stmt *stmt);
 
-    while (fgets(line, sizeof(line), stdin) != NULL) {
-        // Remove trailing newline and carriage return characters
-        size_t len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') line[len - 1] = '\0';
-        if (len > 0 && line[len - 1] == '\r') line[len - 1] = '\0';
+// Statements of a scope, releasing its variables and arrays at the end
+static void vm_scope(VmCompiler *c, const Stmt *first) {
+    int locals = c->locals;
+    int live = c->live_count;
+    for (const Stmt *stmt = first; stmt != NULL; stmt = stmt->next) vm_stmt(c, stmt);
+    vm_flush_text(c);
+    vm_free_live(c, live);
+    c->live_count = live;
+    c->locals = c->next_register = locals;
+}
 
-        char trimmed_line[256];
-        strcpy(trimmed_line, line);
-        trim(trimmed_line); // Trim leading/trailing whitespace for parsing
+// The body of an if or for: a single statement, but read as a list, which
+// may be empty, in case -O left the statements of a taken arm there
+static void vm_body(VmCompiler *c, const Stmt *body) {
+    for (const Stmt *stmt = body; stmt != NULL; stmt = stmt->next) vm_stmt(c, stmt);
+    vm_flush_text(c);
+}
 
-        // Handle empty lines
-        if (strlen(trimmed_line) == 0) {
-            printf("\n");
-            continue;
+static void vm_stmt(VmCompiler *c, const Stmt *stmt) {
+    c->line = stmt->line;
+    if (stmt->kind != STMT_PRINT) vm_flush_text(c);
+    switch (stmt->kind) {
+    case STMT_DECL:
+        vm_local_decl(c, stmt->decl);
+        break;
+    case STMT_EXPR:
+        vm_effect(c, stmt->expr);
+        break;
+    case STMT_PRINT:
+        vm_print(c, stmt->expr);
+        break;
+    case STMT_RETURN:
+        if (stmt->expr != NULL) {
+            int value = vm_operand(c, stmt->expr);
+            vm_free_live(c, 0);
+            vm_emit(c, OP_RETURN, value, 0, 0);
+        } else {
+            vm_free_live(c, 0);
+            vm_emit(c, OP_RETURN_VOID, 0, 0, 0);
         }
-
-        // Handle multiline comments /* ... */
-        if (strstr(trimmed_line, "/*") != NULL) {
-            in_multiline_comment = true;
+        break;
+    case STMT_IF: {
+        int skip_then = vm_emit(c, OP_JUMP_IF_FALSE, vm_operand(c, stmt->expr), 0, 0);
+        c->next_register = c->locals;
+        vm_body(c, stmt->body);
+        if (stmt->else_body != NULL) {
+            int skip_else = vm_emit(c, OP_JUMP, 0, 0, 0);
+            vm_patch(c, skip_then);
+            vm_body(c, stmt->else_body);
+            vm_patch(c, skip_else);
+        } else {
+            vm_patch(c, skip_then);
         }
-        if (in_multiline_comment) {
-            // Print the comment line as is, maintaining original indentation
-            printf("%s\n", line);
-            if (strstr(trimmed_line, "*/") != NULL) {
-                in_multiline_comment = false;
-            }
-            continue;
+        break;
+    }
+    case STMT_FOR: {
+        // The condition is tested at the bottom, so each iteration takes one jump
+        int locals = c->locals;
+        int live = c->live_count;
+        if (stmt->decl != NULL) vm_local_decl(c, stmt->decl);
+        if (stmt->init != NULL) vm_effect(c, stmt->init);
+        c->next_register = c->locals;
+        int to_condition = vm_emit(c, OP_JUMP, 0, 0, 0);
+        int body = c->function->code_count;
+        vm_body(c, stmt->body);
+        c->line = stmt->line;
+        if (stmt->step != NULL) vm_effect(c, stmt->step);
+        c->next_register = c->locals;
+        vm_patch(c, to_condition);
+        if (stmt->expr != NULL) {
+            int condition = vm_operand(c, stmt->expr);
+            vm_emit(c, OP_JUMP_IF_TRUE, condition, body - c->function->code_count, 0);
+        } else {
+            vm_emit(c, OP_JUMP, 0, body - c->function->code_count, 0);
         }
+        vm_free_live(c, live);
+        c->live_count = live;
+        c->locals = locals;
+        break;
+    }
+    case STMT_BLOCK:
+        vm_scope(c, stmt->body);
+        break;
+    case STMT_UNHANDLED:
+        vm_unsupported(c, stmt->line, "statements that could not be parsed");
+        break;
+    }
+    c->next_register = c->locals;
+}
 
-        // Handle single-line comments //
-        if (trimmed_line[0] == '/' && trimmed_line[1] == '/') {
-            printf("%s\n", line); // Print the comment line as is
-            continue;
+static void vm_function(VmCompiler *c, const Decl *decl) {
+    c->function = &c->program->functions[decl->symbol->slot];
+    c->live_count = 0;
+    c->locals = c->next_register = 0;
+    for (Param *param = decl->type->params; param != NULL; param = param->next) {
+        if (param->symbol != NULL) param->symbol->slot = c->next_register;
+        vm_register(c);
+        c->locals++;
+    }
+    stmt_any_expr(decl->body->body, count_array_use);
+    c->line = decl->line;
+    vm_scope(c, decl->body->body);
+    vm_emit(c, OP_RETURN_VOID, 0, 0, 0);
+}
+
+// Lower a resolved program. Function 0 sets the globals in order, then
+// calls main and returns what it returns.
+static bool vm_compile(VmProgram *program, const Program *tree, const Interner *interner, Diagnostics *diagnostics) {
+    int *function_of_name = calloc((size_t)interner->count + 1, sizeof(int));
+    if (function_of_name == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
+    program->function_count = 1;
+    const Decl *main_decl = NULL;
+    for (const Stmt *item = tree->items; item != NULL; item = item->next) {
+        if (item->kind != STMT_DECL) continue;
+        const Decl *decl = item->decl;
+        if (decl->type->kind != TYPE_FUNCTION) {
+            decl->symbol->slot = program->global_count++;
+        } else if (decl->body != NULL) {
+            decl->symbol->slot = function_of_name[decl->name_id] = program->function_count++;
+            if (decl_is_main(decl)) main_decl = decl;
         }
+    }
+    program->functions = calloc((size_t)program->function_count, sizeof(VmFunction));
+    program->globals = calloc((size_t)program->global_count + 1, sizeof(VmValue));
+    if (program->functions == NULL || program->globals == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
 
-        // Adjust brace level for closing braces before printing line content
-        if (strcmp(trimmed_line, "}") == 0) {
-            brace_level--;
+    VmCompiler c = { 0 };
+    c.program = program;
+    c.diagnostics = diagnostics;
+    c.function_of_name = function_of_name;
+    c.text.fd = -1;
+    c.function = &program->functions[0];
+    for (const Stmt *item = tree->items; item != NULL; item = item->next) {
+        c.line = item->line;
+        if (item->kind == STMT_UNHANDLED) {
+            vm_unsupported(&c, item->line, "statements that could not be parsed");
+            continue;
+        }
+        const Decl *decl = item->decl;
+        if (decl->type->kind == TYPE_FUNCTION) continue;
+        // Scalars without an initializer keep the zero they start with
+        if (decl->value == NULL && (decl->type->kind != TYPE_ARRAY || decl->type->size == NULL)) continue;
+        c.next_register = 0;
+        int reg = vm_register(&c);
+        vm_variable(&c, decl, reg);
+        vm_emit(&c, OP_SET_GLOBAL, reg, decl->symbol->slot, 0);
+    }
+    if (main_decl == NULL) {
+        output_puts(diagnostics->out, "bminor2c: no main function to run\n");
+        c.error_count++;
+    } else {
+        // main is called without arguments, as in the generated C
+        c.line = main_decl->line;
+        c.next_register = 0;
+        int result = vm_register(&c);
+        int first = c.next_register;
+        for (const Param *param = main_decl->type->params; param != NULL; param = param->next) {
+            vm_emit(&c, OP_LOAD_INT, vm_register(&c), 0, 0);
         }
+        vm_emit(&c, OP_CALL, result, main_decl->symbol->slot, first);
+        vm_emit(&c, OP_RETURN, result, 0, 0);
+    }
 
-        // Add indentation based on current brace_level
-        for (int i = 0; i < brace_level; i++) {
-            printf("    ");
+    for (const Stmt *item = tree->items; item != NULL; item = item->next) {
+        if (item->kind == STMT_DECL && item->decl->type->kind == TYPE_FUNCTION && item->decl->body != NULL) {
+            vm_function(&c, item->decl);
         }
+    }
+    free(c.text.data);
+    free(c.live);
+    free(function_of_name);
+    return c.error_count == 0;
+}
 
-        // Handle specific Bminor constructs in order of specificity
+static void vm_free(VmProgram *program) {
+    for (int i = 0; i < program->function_count; i++) {
+        free(program->functions[i].code);
+        free(program->functions[i].lines);
+    }
+    for (int i = 0; i < program->string_count; i++) free(program->strings[i]);
+    free(program->functions);
+    free(program->globals);
+    free(program->strings);
+    free(program->string_lengths);
+}
 
-        // Handle opening brace
-        if (strcmp(trimmed_line, "{") == 0) {
-            printf("{\n");
-            brace_level++;
-            continue;
-        }
+static VmArray *vm_new_array(int32_t length) {
+    VmArray *array = calloc(1, sizeof(VmArray) + (size_t)length * sizeof(VmValue));
+    if (array == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
+    array->length = length;
+    return array;
+}
+
+// Same results as bminor_ipow() in the generated C
+static int32_t vm_power(int32_t base, int32_t exponent) {
+    if (exponent < 0) return base == 1 ? 1 : base == -1 ? (exponent & 1 ? -1 : 1) : 0;
+    uint32_t result = 1, factor = (uint32_t)base;
+    for (; exponent > 0; exponent >>= 1) {
+        if (exponent & 1) result *= factor;
+        factor *= factor;
+    }
+    return (int32_t)result;
+}
 
-        // Function definition
-        if (strstr(trimmed_line, ": function") != NULL) {
-            char func_name[64];
-            char return_type[32];
-            char params_raw[128] = "";
-            char *open_paren = strchr(trimmed_line, '(');
-            char *close_paren = strchr(trimmed_line, ')');
+static void vm_print_int(OutputBuffer *out, int32_t value) {
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+        *--p = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--p = '-';
+    output_write(out, p, (size_t)(digits + sizeof(digits) - p));
+}
 
-            if (open_paren && close_paren) {
-                strncpy(params_raw, open_paren + 1, close_paren - (open_paren + 1));
-                params_raw[close_paren - (open_paren + 1)] = '\0';
-                trim(params_raw);
-            }
+// Where a call returns to
+typedef struct {
+    const VmInstr *return_pc;
+    VmValue *registers;
+    VmValue *result;
+} VmFrame;
 
-            // Extract function name and return type
-            sscanf(trimmed_line, "%[^:]: function %s", func_name, return_type);
-            trim(func_name); trim(return_type);
-
-            // Convert return type
-            char c_return_type[32];
-            if (strcmp(return_type, "integer") == 0) strcpy(c_return_type, "int");
-            else if (strcmp(return_type, "string") == 0) strcpy(c_return_type, "char*");
-            else if (strcmp(return_type, "boolean") == 0) strcpy(c_return_type, "bool");
-            else strcpy(c_return_type, "void"); // Default for unknown types
-
-            // Convert parameters
-            char c_params[256] = "";
-            if (strlen(params_raw) > 0) {
-                char *param_token = strtok(params_raw, ",");
-                while (param_token != NULL) {
-                    trim(param_token); // Trim each parameter token
-                    char p_name[64];
-                    char p_type[32];
-                    sscanf(param_token, "%[^:]: %s", p_name, p_type);
-                    trim(p_name); trim(p_type);
-
-                    char c_p_type[32];
-                    if (strcmp(p_type, "integer") == 0) strcpy(c_p_type, "int");
-                    else if (strcmp(p_type, "string") == 0) strcpy(c_p_type, "char*");
-                    else if (strcmp(p_type, "boolean") == 0) strcpy(c_p_type, "bool");
-                    else strcpy(c_p_type, "void");
-
-                    if (strlen(c_params) > 0) strcat(c_params, ", ");
-                    strcat(c_params, c_p_type);
-                    strcat(c_params, " ");
-                    strcat(c_params, p_name);
-
-                    param_token = strtok(NULL, ",");
-                }
-            }
+// Source line of the instruction at pc
+static int vm_line(const VmProgram *program, const VmInstr *pc) {
+    for (int i = 0; i < program->function_count; i++) {
+        const VmFunction *function = &program->functions[i];
+        if (pc >= function->code && pc < function->code + function->code_count) return function->lines[pc - function->code];
+    }
+    return 0;
+}
 
-            if (strcmp(func_name, "main") == 0) {
-                printf("%s %s() {\n", c_return_type, func_name); // Simplified main signature
-                // Allocate dynamic_array here for global dynamic arrays (runtime operation)
-                printf("    dynamic_array = malloc(10 * sizeof(int));\n");
-                printf("    if (dynamic_array == NULL) { fprintf(stderr, \"Memory allocation failed!\\n\"); return 1; }\n");
-            } else {
-                printf("%s %s(%s) {\n", c_return_type, func_name, c_params);
-            }
-            in_function_body = true;
-            // Brace level will be incremented by the following '{' line
-            continue;
+// Run a compiled program. Returns main's result, or 1 after a runtime error.
+// With GCC and Clang every handler jumps straight to the next one through a
+// table of label addresses; elsewhere a switch in a loop does the dispatch.
+static int vm_execute(const VmProgram *program, OutputBuffer *out, Diagnostics *diagnostics) {
+    VmValue *stack = checked_realloc(NULL, (size_t)VM_STACK_SLOTS * sizeof(VmValue));
+    VmFrame *frames = checked_realloc(NULL, (size_t)VM_MAX_DEPTH * sizeof(VmFrame));
+    const VmValue *stack_end = stack + VM_STACK_SLOTS;
+    const VmFunction *functions = program->functions;
+    VmValue *globals = program->globals;
+    VmValue *r = stack;
+    const VmInstr *pc = functions[0].code;
+    int depth = 0;
+    int status = 0;
+    const char *error = NULL;
+    VmValue result;
+
+#if defined(__GNUC__)
+#define VM_LABEL(name) &&label_##name,
+    static void *const labels[OP_COUNT] = { VM_OPCODES(VM_LABEL) };
+#undef VM_LABEL
+#define VM_OP(name) label_##name:
+#define VM_DISPATCH() goto *labels[pc->op]
+    VM_DISPATCH();
+    {
+#else
+#define VM_OP(name) case name:
+#define VM_DISPATCH() continue
+    for (;;) switch (pc->op) {
+#endif
+    VM_OP(OP_MOVE) r[pc->a] = r[pc->b]; pc++; VM_DISPATCH();
+    VM_OP(OP_LOAD_INT) r[pc->a].i = pc->b; pc++; VM_DISPATCH();
+    VM_OP(OP_LOAD_STRING) r[pc->a].s = program->strings[pc->b]; pc++; VM_DISPATCH();
+    VM_OP(OP_LOAD_NULL) r[pc->a].array = NULL; pc++; VM_DISPATCH();
+    VM_OP(OP_GET_GLOBAL) r[pc->a] = globals[pc->b]; pc++; VM_DISPATCH();
+    VM_OP(OP_SET_GLOBAL) globals[pc->b] = r[pc->a]; pc++; VM_DISPATCH();
+    VM_OP(OP_ADD) r[pc->a].i = (int32_t)((uint32_t)r[pc->b].i + (uint32_t)r[pc->c].i); pc++; VM_DISPATCH();
+    VM_OP(OP_SUB) r[pc->a].i = (int32_t)((uint32_t)r[pc->b].i - (uint32_t)r[pc->c].i); pc++; VM_DISPATCH();
+    VM_OP(OP_MUL) r[pc->a].i = (int32_t)((uint32_t)r[pc->b].i * (uint32_t)r[pc->c].i); pc++; VM_DISPATCH();
+    VM_OP(OP_DIV)
+        if (r[pc->c].i == 0) {
+            error = "division by zero";
+            goto failed;
+        }
+        r[pc->a].i = r[pc->c].i == -1 ? (int32_t)(0u - (uint32_t)r[pc->b].i) : r[pc->b].i / r[pc->c].i;
+        pc++;
+        VM_DISPATCH();
+    VM_OP(OP_MOD)
+        if (r[pc->c].i == 0) {
+            error = "division by zero";
+            goto failed;
+        }
+        r[pc->a].i = r[pc->c].i == -1 ? 0 : r[pc->b].i % r[pc->c].i;
+        pc++;
+        VM_DISPATCH();
+    VM_OP(OP_POW) r[pc->a].i = vm_power(r[pc->b].i, r[pc->c].i); pc++; VM_DISPATCH();
+    VM_OP(OP_ADD_INT) r[pc->a].i = (int32_t)((uint32_t)r[pc->b].i + (uint32_t)pc->c); pc++; VM_DISPATCH();
+    VM_OP(OP_NEG) r[pc->a].i = (int32_t)(0u - (uint32_t)r[pc->b].i); pc++; VM_DISPATCH();
+    VM_OP(OP_NOT) r[pc->a].i = !r[pc->b].i; pc++; VM_DISPATCH();
+    VM_OP(OP_EQ) r[pc->a].i = r[pc->b].i == r[pc->c].i; pc++; VM_DISPATCH();
+    VM_OP(OP_NE) r[pc->a].i = r[pc->b].i != r[pc->c].i; pc++; VM_DISPATCH();
+    VM_OP(OP_LT) r[pc->a].i = r[pc->b].i < r[pc->c].i; pc++; VM_DISPATCH();
+    VM_OP(OP_LE) r[pc->a].i = r[pc->b].i <= r[pc->c].i; pc++; VM_DISPATCH();
+    VM_OP(OP_GT) r[pc->a].i = r[pc->b].i > r[pc->c].i; pc++; VM_DISPATCH();
+    VM_OP(OP_GE) r[pc->a].i = r[pc->b].i >= r[pc->c].i; pc++; VM_DISPATCH();
+    VM_OP(OP_EQ_REF) r[pc->a].i = r[pc->b].s == r[pc->c].s; pc++; VM_DISPATCH();
+    VM_OP(OP_NE_REF) r[pc->a].i = r[pc->b].s != r[pc->c].s; pc++; VM_DISPATCH();
+    VM_OP(OP_JUMP) pc += pc->b; VM_DISPATCH();
+    VM_OP(OP_JUMP_IF_FALSE) pc += r[pc->a].i ? 1 : pc->b; VM_DISPATCH();
+    VM_OP(OP_JUMP_IF_TRUE) pc += r[pc->a].i ? pc->b : 1; VM_DISPATCH();
+    VM_OP(OP_NEW_ARRAY)
+        if (r[pc->b].i < 0) {
+            error = "negative array size";
+            goto failed;
+        }
+        r[pc->a].array = vm_new_array(r[pc->b].i);
+        pc++;
+        VM_DISPATCH();
+    VM_OP(OP_ARRAY_LIST) {
+        VmArray *array = vm_new_array(r[pc->a].i > pc->c ? r[pc->a].i : pc->c);
+        memcpy(array->items, r + pc->b, (size_t)pc->c * sizeof(VmValue));
+        r[pc->a].array = array;
+        pc++;
+        VM_DISPATCH();
+    }
+    VM_OP(OP_INDEX) {
+        const VmArray *array = r[pc->b].array;
+        if (array == NULL || (uint32_t)r[pc->c].i >= (uint32_t)array->length) {
+            error = array == NULL ? "array was never allocated" : "array index out of bounds";
+            goto failed;
         }
+        r[pc->a] = array->items[r[pc->c].i];
+        pc++;
+        VM_DISPATCH();
+    }
+    VM_OP(OP_SET_INDEX) {
+        VmArray *array = r[pc->a].array;
+        if (array == NULL || (uint32_t)r[pc->b].i >= (uint32_t)array->length) {
+            error = array == NULL ? "array was never allocated" : "array index out of bounds";
+            goto failed;
+        }
+        array->items[r[pc->b].i] = r[pc->c];
+        pc++;
+        VM_DISPATCH();
+    }
+    VM_OP(OP_FREE_ARRAY) free(r[pc->a].array); pc++; VM_DISPATCH();
+    VM_OP(OP_CALL) {
+        const VmFunction *callee = &functions[pc->b];
+        VmValue *registers = r + pc->c;
+        if (depth == VM_MAX_DEPTH || registers + callee->frame_size > stack_end) {
+            error = "calls nested too deeply";
+            goto failed;
+        }
+        frames[depth++] = (VmFrame){ pc + 1, r, r + pc->a };
+        r = registers;
+        pc = callee->code;
+        VM_DISPATCH();
+    }
+    VM_OP(OP_RETURN)
+        result = r[pc->a];
+        goto returned;
+    VM_OP(OP_RETURN_VOID)
+        result.i = 0;
+    returned:
+        if (depth == 0) {
+            status = result.i;
+            goto finished;
+        }
+        depth--;
+        *frames[depth].result = result;
+        r = frames[depth].registers;
+        pc = frames[depth].return_pc;
+        VM_DISPATCH();
+    VM_OP(OP_PRINT_INT) vm_print_int(out, r[pc->a].i); pc++; VM_DISPATCH();
+    VM_OP(OP_PRINT_BOOL) output_puts(out, r[pc->a].i ? "true" : "false"); pc++; VM_DISPATCH();
+    VM_OP(OP_PRINT_CHAR) {
+        char ch = (char)r[pc->a].i;
+        output_write(out, &ch, 1);
+        pc++;
+        VM_DISPATCH();
+    }
+    VM_OP(OP_PRINT_STRING) output_puts(out, r[pc->a].s != NULL ? r[pc->a].s : "(null)"); pc++; VM_DISPATCH();
+    VM_OP(OP_PRINT_TEXT)
+        output_write(out, program->strings[pc->a], program->string_lengths[pc->a]);
+        pc++;
+        VM_DISPATCH();
+    }
+#undef VM_OP
+#undef VM_DISPATCH
 
-        // Print statements (Moved up for priority and fixed semicolon handling)
-        if (strstr(trimmed_line, "print ") == trimmed_line) { // Line starts with "print "
-            char print_args_raw[256];
-            strcpy(print_args_raw, trimmed_line + strlen("print "));
-            // Remove trailing semicolon from the raw arguments string before parsing
-            if (strlen(print_args_raw) > 0 && print_args_raw[strlen(print_args_raw) - 1] == ';') {
-                print_args_raw[strlen(print_args_raw) - 1] = '\0';
-            }
-            trim(print_args_raw); // Now trim
-
-            char format_string[512] = "";
-            char printf_args_list[512] = ""; // For variables/expressions passed as arguments
-            bool first_printf_arg = true;
-
-            // Use a temporary copy for strtok as it modifies the string
-            char temp_args[256];
-            strcpy(temp_args, print_args_raw);
-
-            char *token = strtok(temp_args, ",");
-            while (token != NULL) {
-                trim(token);
-                if (token[0] == '"' && token[strlen(token) - 1] == '"') {
-                    // Check if it's explicitly the newline string literal "\n"
-                    if (strcmp(token, "\"\\n\"") == 0) {
-                        strcat(format_string, "\\n"); // Append as actual newline to format string
-                    } else {
-                        // It's a general string literal, remove quotes and append directly to format string
-                        token[strlen(token) - 1] = '\0'; // Remove closing quote
-                        strcat(format_string, token + 1); // Append content after opening quote
-                    }
-                } else { // Variable or expression
-                    // Basic type deduction (can be improved with a full symbol table)
-                    // Assuming 'name' is char*, others are int based on context
-                    bool is_string_variable = (strcmp(token, "name") == 0);
-                    
-                    if (is_string_variable) {
-                        strcat(format_string, "%s");
-                    } else {
-                        strcat(format_string, "%d"); // Assume integer for others
-                    }
-                    
-                    if (!first_printf_arg) {
-                        strcat(printf_args_list, ", ");
-                    }
-                    strcat(printf_args_list, token);
-                    first_printf_arg = false;
-                }
-                token = strtok(NULL, ",");
-            }
-            printf("printf(\"%s\"", format_string);
-            if (strlen(printf_args_list) > 0) {
-                printf(", %s", printf_args_list);
-            }
-            printf(");\n"); // Correct closing parenthesis and semicolon
-            continue;
+failed:
+    // Whatever the program printed comes before the error
+    output_flush(out);
+    diagnose(diagnostics, vm_line(program, pc), "runtime error: %s", error);
+    status = 1;
+finished:
+    free(stack);
+    free(frames);
+    return status;
+}
+
+// Run one Bminor program (--run). Returns the exit status: main's result,
+// or 1 if the program has errors or fails while running.
+static int run_program(const char *source, size_t length, OutputBuffer *out, Diagnostics *diagnostics,
+                       const Options *options, Arena *arena) {
+    Interner interner = { 0 };
+    Parser parser;
+    parser_init(&parser, source, length, arena, &interner, diagnostics);
+    Program *tree = parse_program(&parser);
+    SymbolTable symbols;
+    symbols_init(&symbols, arena, &interner, diagnostics);
+    resolve_program(&symbols, tree);
+    if (options->optimize) {
+        Folder folder = { arena, 0, 0 };
+        fold_program(&folder, tree);
+    }
+
+    int status = 1;
+    VmProgram program = { 0 };
+    if (symbols.error_count == 0 && vm_compile(&program, tree, &interner, diagnostics)) {
+        status = vm_execute(&program, out, diagnostics);
+        output_flush(out);
+    }
+    vm_free(&program);
+    symbols_free(&symbols);
+    interner_free(&interner);
+    return status;
+}
+
+// One input of a batch and the C file it is translated into
+typedef struct {
+    char *input_path;
+    char *output_path;
+    off_t size;
+} BatchJob;
+
+// A batch shared by all worker threads. Jobs are handed out largest first
+// from a single atomic cursor, so an idle worker always takes the next
+// pending file and no thread is left with a long tail of big inputs.
+typedef struct {
+    BatchJob *jobs;
+    size_t job_count;
+    size_t job_capacity;
+    const char *output_dir;     // -o: where outputs go instead of next to their inputs
+    const Options *options;
+    Stats *stats;               // --stats: totals over all files
+    pthread_mutex_t stats_lock;
+    atomic_size_t next_job;
+    atomic_int failures;        // Files that could not be read or written
+    atomic_int diagnostics;     // Messages reported across all files
+} Batch;
+
+static char *checked_strdup(const char *text) {
+    char *copy = strdup(text);
+    if (copy == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
+    return copy;
+}
+
+// foo/bar.bminor becomes foo/bar.c, or DIR/bar.c with -o DIR
+static char *batch_output_path(const Batch *batch, const char *input_path) {
+    const char *name = input_path;
+    if (batch->output_dir != NULL) {
+        const char *slash = strrchr(input_path, '/');
+        if (slash != NULL) name = slash + 1;
+    }
+    size_t length = strlen(name);
+    const char *suffix = ".bminor";
+    size_t suffix_length = strlen(suffix);
+    if (length > suffix_length && strcmp(name + length - suffix_length, suffix) == 0) length -= suffix_length;
+
+    size_t dir_length = batch->output_dir != NULL ? strlen(batch->output_dir) + 1 : 0;
+    char *path = malloc(dir_length + length + 3);
+    if (path == NULL) {
+        fprintf(stderr, "bminor2c: out of memory\n");
+        exit(1);
+    }
+    if (batch->output_dir != NULL) sprintf(path, "%s/", batch->output_dir);
+    memcpy(path + dir_length, name, length);
+    memcpy(path + dir_length + length, ".c", 3);
+    return path;
+}
+
+static void batch_add(Batch *batch, const char *input_path, off_t size) {
+    if (batch->job_count == batch->job_capacity) {
+        batch->job_capacity = batch->job_capacity ? batch->job_capacity * 2 : 64;
+        batch->jobs = checked_realloc(batch->jobs, batch->job_capacity * sizeof(BatchJob));
+    }
+    BatchJob *job = &batch->jobs[batch->job_count++];
+    job->input_path = checked_strdup(input_path);
+    job->output_path = batch_output_path(batch, input_path);
+    job->size = size;
+}
+
+// Add a file, or every .bminor file below a directory
+static bool batch_collect(Batch *batch, const char *path, bool explicit) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "bminor2c: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        size_t length = strlen(path);
+        if (explicit || (length > 7 && strcmp(path + length - 7, ".bminor") == 0)) batch_add(batch, path, st.st_size);
+        return true;
+    }
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "bminor2c: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    size_t path_length = strlen(path);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char *child = malloc(path_length + strlen(entry->d_name) + 2);
+        if (child == NULL) {
+            fprintf(stderr, "bminor2c: out of memory\n");
+            exit(1);
         }
+        sprintf(child, "%s/%s", path, entry->d_name);
+        ok = batch_collect(batch, child, false) && ok;
+        free(child);
+    }
+    closedir(dir);
+    return ok;
+}
 
-        // If statement
-        if (strstr(trimmed_line, "if (") == trimmed_line) {
-            char condition[128];
-            sscanf(trimmed_line, "if (%[^)]) {", condition);
-            trim(condition);
+static int compare_jobs_largest_first(const void *a, const void *b) {
+    off_t size_a = ((const BatchJob *)a)->size;
+    off_t size_b = ((const BatchJob *)b)->size;
+    return (size_a < size_b) - (size_a > size_b);
+}
 
-            // Replace Bminor logical operators with C operators
-            char temp_cond[128];
-            strcpy(temp_cond, condition);
-            char* ptr;
+// Translate one file of a batch. Output and messages go through buffers
+// owned by the calling worker, which are reused from job to job.
+static void batch_run_job(Batch *batch, const BatchJob *job, OutputBuffer *out, OutputBuffer *messages) {
+    Stats stats = { 0 };
+    double mark = batch->stats != NULL ? now_seconds() : 0;
+    int input_fd = open(job->input_path, O_RDONLY);
+    InputBuffer input;
+    if (input_fd < 0 || !load_input(input_fd, &input)) {
+        output_printf(messages, "bminor2c: %s: %s\n", job->input_path, strerror(errno));
+        if (input_fd >= 0) close(input_fd);
+        atomic_fetch_add(&batch->failures, 1);
+        return;
+    }
+    close(input_fd);
 
-            ptr = strstr(temp_cond, " and ");
-            while (ptr) { memcpy(ptr, " && ", 4); ptr = strstr(ptr + 4, " and "); }
-            ptr = strstr(temp_cond, " or ");
-            while (ptr) { memcpy(ptr, " || ", 4); ptr = strstr(ptr + 4, " or "); }
-            ptr = strstr(temp_cond, " not ");
-            while (ptr) { memcpy(ptr, " ! ", 3); ptr = strstr(ptr + 3, " not "); } // " not " to " !"
+    int output_fd = open(job->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (output_fd < 0) {
+        output_printf(messages, "bminor2c: %s: %s\n", job->output_path, strerror(errno));
+        release_input(&input);
+        atomic_fetch_add(&batch->failures, 1);
+        return;
+    }
 
-            printf("if (%s) {\n", temp_cond);
-            // Brace level will be incremented by the following '{' line
-            continue;
+    out->fd = output_fd;
+    out->error = 0;
+    Diagnostics diagnostics = { job->input_path, messages, 0 };
+    Arena arena = { 0 };
+    if (batch->stats != NULL) stats_phase(&stats, PHASE_READ, &mark);
+    translate(input.data, input.length, out, &diagnostics, batch->options, &arena, batch->stats != NULL ? &stats : NULL);
+    if (batch->stats != NULL) {
+        stats.input_bytes = input.length;
+        stats.arena_allocations = arena.allocation_count;
+        stats.arena_bytes = arena.bytes_used;
+        pthread_mutex_lock(&batch->stats_lock);
+        stats_add(batch->stats, &stats);
+        pthread_mutex_unlock(&batch->stats_lock);
+    }
+    if (close(output_fd) != 0 && out->error == 0) out->error = errno;
+    if (out->error != 0) {
+        output_printf(messages, "bminor2c: %s: %s\n", job->output_path, strerror(out->error));
+        atomic_fetch_add(&batch->failures, 1);
+    }
+    atomic_fetch_add(&batch->diagnostics, diagnostics.count);
+    arena_free(&arena);
+    release_input(&input);
+}
+
+static void *batch_worker(void *arg) {
+    Batch *batch = arg;
+    OutputBuffer out = { NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    OutputBuffer messages = { NULL, 0, 0, STDERR_FILENO, 0, 0, false, 0, NULL, NULL };
+    for (;;) {
+        size_t index = atomic_fetch_add(&batch->next_job, 1);
+        if (index >= batch->job_count) break;
+        batch_run_job(batch, &batch->jobs[index], &out, &messages);
+        output_flush(&messages);
+    }
+    free(out.data);
+    free(messages.data);
+    return NULL;
+}
+
+static int compare_jobs_by_output(const void *a, const void *b) {
+    return strcmp(((const BatchJob *)a)->output_path, ((const BatchJob *)b)->output_path);
+}
+
+// With -o, inputs of the same name in different directories would be
+// written to the same file by two workers at once. Reports every such pair;
+// false if there was one.
+static bool batch_check_outputs(Batch *batch) {
+    qsort(batch->jobs, batch->job_count, sizeof(BatchJob), compare_jobs_by_output);
+    bool ok = true;
+    for (size_t i = 1; i < batch->job_count; i++) {
+        if (strcmp(batch->jobs[i - 1].output_path, batch->jobs[i].output_path) != 0) continue;
+        fprintf(stderr, "bminor2c: %s: written by both %s and %s\n", batch->jobs[i].output_path,
+                batch->jobs[i - 1].input_path, batch->jobs[i].input_path);
+        ok = false;
+    }
+    return ok;
+}
+
+// Translate every job on `thread_count` threads, the calling one included
+static void batch_run(Batch *batch, int thread_count) {
+    qsort(batch->jobs, batch->job_count, sizeof(BatchJob), compare_jobs_largest_first);
+    if ((size_t)thread_count > batch->job_count) thread_count = (int)batch->job_count;
+    if (thread_count < 1) thread_count = 1;
+
+    pthread_t *threads = checked_realloc(NULL, (size_t)thread_count * sizeof(pthread_t));
+    int started = 0;
+    for (; started < thread_count - 1; started++) {
+        if (pthread_create(&threads[started], NULL, batch_worker, batch) != 0) break;
+    }
+    batch_worker(batch);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+}
+
+// Server mode (--server): translate one request after another in a single
+// process, over stdin/stdout or over connections to a Unix socket. A request
+// is a header line holding the length of the source in bytes, optionally
+// followed by " -O", and then the source itself. The reply is a header line
+// "<C bytes> <message bytes> <microseconds>" followed by the generated C and
+// then the messages. Buffers and the arena are kept from request to request.
+#define SERVER_MAX_HEADER 64
+#define SERVER_MAX_REQUEST ((size_t)1 << 30)
+
+typedef struct {
+    int in_fd;
+    char received[1 << 16];     // Read ahead of the request being parsed
+    size_t received_start;
+    size_t received_end;
+    char *source;
+    size_t source_capacity;
+    OutputBuffer out;           // Collects the C of one request
+    OutputBuffer messages;
+    OutputBuffer reply;
+    Arena arena;
+    double *latencies;          // Seconds per request, for the --stats summary
+    size_t request_count;
+    size_t latency_capacity;
+} ServerSession;
+
+// Read more of the request stream; false at end of input or on an error
+static bool server_receive(ServerSession *session) {
+    if (session->received_start == session->received_end) session->received_start = session->received_end = 0;
+    for (;;) {
+        ssize_t n = read(session->in_fd, session->received + session->received_end,
+                         sizeof(session->received) - session->received_end);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        session->received_end += (size_t)n;
+        return true;
+    }
+}
+
+// Next header line without its newline. Sets *at_end when the stream ended
+// cleanly between requests.
+static bool server_read_header(ServerSession *session, char *line, bool *at_end) {
+    *at_end = false;
+    for (;;) {
+        const char *start = session->received + session->received_start;
+        size_t available = session->received_end - session->received_start;
+        const char *newline = memchr(start, '\n', available);
+        if (newline != NULL) {
+            size_t length = (size_t)(newline - start);
+            if (length >= SERVER_MAX_HEADER) return false;
+            memcpy(line, start, length);
+            line[length] = '\0';
+            session->received_start += length + 1;
+            return true;
+        }
+        if (available >= SERVER_MAX_HEADER) return false;
+        // Keep the partial line at the front so the rest can follow it
+        memmove(session->received, start, available);
+        session->received_start = 0;
+        session->received_end = available;
+        if (!server_receive(session)) {
+            *at_end = available == 0;
+            return false;
         }
+    }
+}
+
+// The source of a request, followed by the zero byte the lexer expects
+static bool server_read_source(ServerSession *session, size_t length) {
+    if (session->source_capacity < length + 1) {
+        session->source_capacity = length + 1;
+        session->source = checked_realloc(session->source, session->source_capacity);
+    }
+    size_t buffered = session->received_end - session->received_start;
+    if (buffered > length) buffered = length;
+    memcpy(session->source, session->received + session->received_start, buffered);
+    session->received_start += buffered;
+    for (size_t have = buffered; have < length;) {
+        ssize_t n = read(session->in_fd, session->source + have, length - have);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        have += (size_t)n;
+    }
+    session->source[length] = '\0';
+    return true;
+}
 
-        // Else statement
-        // Handle else statements that are not part of an if block
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
 
-        if (strcmp(trimmed_line, "} else {") == 0) {
-            brace_level--;  // For the closing brace
-            // Print at current brace_level (which is now reduced)
-            for (int i = 0; i < brace_level; i++) {
-                printf("    ");
-            }
-            printf("} else {\n");
-            brace_level++;  // For the new block
-            continue;
+// Latency percentiles and the totals of every request of a session
+static void server_print_stats(ServerSession *session, Stats *stats, bool json) {
+    if (session->request_count == 0) return;
+    double *sorted = session->latencies;
+    qsort(sorted, session->request_count, sizeof(double), compare_doubles);
+    size_t last = session->request_count - 1;
+    fprintf(stderr, "bminor2c: server: %zu requests, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            session->request_count, sorted[last / 2] * 1e3, sorted[last * 99 / 100] * 1e3, sorted[last] * 1e3);
+    stats_print(stats, json);
+}
+
+// Answer requests until the input ends. Returns false if a request was
+// malformed or the reply could not be written.
+static bool server_session(int in_fd, int out_fd, const Options *options, int stats_mode) {
+    ServerSession *session = checked_realloc(NULL, sizeof(ServerSession));
+    memset(session, 0, sizeof(*session));
+    session->in_fd = in_fd;
+    session->out = (OutputBuffer){ NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    session->messages = (OutputBuffer){ NULL, 0, 0, -1, 0, 0, false, 0, NULL, NULL };
+    session->reply = (OutputBuffer){ NULL, 0, 0, out_fd, 0, 0, false, 0, NULL, NULL };
+    Stats stats = { 0 };
+    bool ok = true;
+
+    for (;;) {
+        char header[SERVER_MAX_HEADER];
+        bool at_end;
+        if (!server_read_header(session, header, &at_end)) {
+            ok = at_end;
+            if (!ok) fprintf(stderr, "bminor2c: server: malformed request header\n");
+            break;
         }
-        // Handle else statements that are not part of an if block
-        // This handles the case where "else" is on a new line or after an if block
-        // Check for "else {" on a new line or after an if block
-        // This is a special case where "else" is on a new line after an if block
-        if (strstr(trimmed_line, "else") == trimmed_line && 
-            (strlen(trimmed_line) == 4 || trimmed_line[4] == ' ' || trimmed_line[4] == '\0')) {
-            // If the line is just "else" or "else {"
-            brace_level--; // Close previous block
-            for (int i = 0; i < brace_level; i++) {
-                printf("    ");
+        char *rest;
+        errno = 0;
+        unsigned long long length = strtoull(header, &rest, 10);
+        Options request_options = *options;
+        if (strcmp(rest, " -O") == 0) request_options.optimize = true;
+        else if (*rest != '\0') rest = header;
+        if (rest == header || errno != 0 || length > SERVER_MAX_REQUEST) {
+            fprintf(stderr, "bminor2c: server: malformed request header\n");
+            ok = false;
+            break;
+        }
+        if (!server_read_source(session, (size_t)length)) {
+            fprintf(stderr, "bminor2c: server: request ended early\n");
+            ok = false;
+            break;
+        }
+
+        double start = now_seconds();
+        Diagnostics diagnostics = { NULL, &session->messages, 0 };
+        translate(session->source, (size_t)length, &session->out, &diagnostics, &request_options, &session->arena,
+                  stats_mode != 0 ? &stats : NULL);
+        double latency = now_seconds() - start;
+        output_printf(&session->reply, "%zu %zu %.0f\n", session->out.length, session->messages.length, latency * 1e6);
+        output_write(&session->reply, session->out.data, session->out.length);
+        output_write(&session->reply, session->messages.data, session->messages.length);
+        output_flush(&session->reply);
+        if (session->reply.error != 0) {
+            ok = false;
+            break;
+        }
+
+        if (stats_mode != 0) {
+            stats.input_bytes += length;
+            stats.output_bytes += session->out.length;
+            stats.arena_allocations += session->arena.allocation_count;
+            stats.arena_bytes += session->arena.bytes_used;
+            if (session->request_count == session->latency_capacity) {
+                session->latency_capacity = session->latency_capacity ? session->latency_capacity * 2 : 1024;
+                session->latencies = checked_realloc(session->latencies, session->latency_capacity * sizeof(double));
             }
-            printf("} else {\n"); // Print else block
-            brace_level++; // Open new block
-            continue;
+            session->latencies[session->request_count] = latency;
         }
-        
+        session->request_count++;
+        session->out.length = 0;
+        session->messages.length = 0;
+        arena_reset(&session->arena);
+    }
+
+    if (stats_mode != 0) server_print_stats(session, &stats, stats_mode == 2);
+    arena_free(&session->arena);
+    free(session->source);
+    free(session->out.data);
+    free(session->messages.data);
+    free(session->reply.data);
+    free(session->latencies);
+    free(session);
+    return ok;
+}
 
+typedef struct {
+    int fd;
+    const Options *options;
+    int stats_mode;
+} ServerConnection;
 
+static void *server_connection(void *arg) {
+    ServerConnection *connection = arg;
+    server_session(connection->fd, connection->fd, connection->options, connection->stats_mode);
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
 
-        if (strcmp(trimmed_line, "else {") == 0) {
-            printf("} else {\n"); // Close previous block and open else
-            // Brace level will be incremented by the following '{' line
-            continue;
-        }
+// Accept connections on a Unix socket, each served by a thread of its own,
+// until the process is stopped
+static bool server_listen(const char *path, const Options *options, int stats_mode) {
+    struct sockaddr_un address = { 0 };
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "bminor2c: %s: %s\n", path, strerror(ENAMETOOLONG));
+        return false;
+    }
+    strcpy(address.sun_path, path);
+    // A socket left behind by an earlier server is replaced
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
 
-        // For loop
-        if (strstr(trimmed_line, "for(") == trimmed_line) {
-            char init_part[64], cond_part[64], incr_part[64];
-            
-            // Extract parts of the for loop
-            if (sscanf(trimmed_line, "for(%[^;];%[^;];%[^)]) {", init_part, cond_part, incr_part) == 3) {
-                trim(init_part); trim(cond_part); trim(incr_part);
-
-                // Handle variable declaration in initialization (e.g., i: integer = 0)
-                if (strstr(init_part, ": integer") != NULL) {
-                    char var_name[32], var_value[32];
-                    sscanf(init_part, "%[^:]: integer = %s", var_name, var_value);
-                    trim(var_name); trim(var_value);
-                    printf("int %s = %s;\n", var_name, var_value); // Declare before for loop
-                    snprintf(init_part, sizeof(init_part), "%s = %s", var_name, var_value); // Update init for C for loop
-                } else {
-                    // If it's just an assignment or existing variable, keep as is
-                }
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, 64) != 0) {
+        fprintf(stderr, "bminor2c: %s: %s\n", path, strerror(errno));
+        if (listen_fd >= 0) close(listen_fd);
+        return false;
+    }
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "bminor2c: %s: %s\n", path, strerror(errno));
+            close(listen_fd);
+            return false;
+        }
+        ServerConnection *connection = checked_realloc(NULL, sizeof(ServerConnection));
+        *connection = (ServerConnection){ fd, options, stats_mode };
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, server_connection, connection) == 0) pthread_detach(thread);
+        else server_connection(connection);
+    }
+}
 
-                // Convert power operator in condition and increment
-                convert_power(cond_part);
-                convert_power(incr_part);
+static void usage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options] [input.bminor]\n"
+            "       %s [options] --batch [-j threads] [-o dir] file-or-dir...\n"
+            "       %s [options] --server [--socket path]\n"
+            "       %s [-O] [--memory-stats] --run [input.bminor]\n"
+            "       %s [-O] [--buffered-output] [--parallel] --split N [-o dir] [input.bminor]\n"
+            "options: -O, --buffered-output, --parallel, --profile, --stream, --memory-stats, --stats[=json], --cache dir, --cache-size MiB, --cache-stats\n",
+            program, program, program, program, program);
+}
 
-                // Convert common increment patterns (e.g., i = i + 1 -> i++)
-                char temp_incr_var[64]; // Use a temp var to prevent sscanf overwriting incr_part
-                if (sscanf(incr_part, "%[^ ] = %[^ ] + 1", temp_incr_var, temp_incr_var) == 2) {
-                    snprintf(incr_part, sizeof(incr_part), "%s++", temp_incr_var);
-                }
+// Write back what this run added to the cache; false if that failed
+static bool finish_cache(Cache *cache, bool cache_stats) {
+    if (cache == NULL) return true;
+    bool ok = cache_close(cache);
+    if (!ok) fprintf(stderr, "bminor2c: %s: could not update cache\n", cache->pack_path);
+    if (cache_stats) {
+        fprintf(stderr, "bminor2c: cache: %zu hits, %zu misses, %zu stored, %zu evicted, %zu of %zu KiB used\n",
+                atomic_load(&cache->hits), atomic_load(&cache->misses), cache->pending_count, cache->evicted,
+                cache->pack_length / 1024, cache->max_bytes / 1024);
+    }
+    return ok;
+}
 
-                printf("for(%s; %s; %s) {\n", init_part, cond_part, incr_part);
-                // Brace level will be incremented by the following '{' line
-                continue;
+#ifndef BMINOR2C_NO_MAIN
+int main(int argc, char **argv) {
+    bool memory_stats = false;
+    bool batch_mode = false;
+    bool server_mode = false;
+    bool stream_mode = false;
+    bool run_mode = false;
+    int split_count = 0;        // --split N; 0 writes one C file to stdout
+    const char *socket_path = NULL;
+    int thread_count = 0;
+    const char *output_dir = NULL;
+    Options options = { false, NULL, false, false, false };
+    const char *cache_dir = NULL;
+    size_t cache_mib = 256;
+    bool cache_stats = false;
+    int stats_mode = 0;  // 1 = --stats, 2 = --stats=json
+    const char *input_path = NULL;
+    int first_input = argc;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--memory-stats") == 0) {
+            memory_stats = true;
+        } else if (strcmp(argv[i], "-O") == 0) {
+            options.optimize = true;
+        } else if (strcmp(argv[i], "--buffered-output") == 0) {
+            options.buffered_output = true;
+        } else if (strcmp(argv[i], "--parallel") == 0) {
+            options.parallel = true;
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            options.profile = true;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch_mode = true;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            stream_mode = true;
+        } else if (strcmp(argv[i], "--server") == 0) {
+            server_mode = true;
+        } else if (strcmp(argv[i], "--run") == 0) {
+            run_mode = true;
+        } else if (strcmp(argv[i], "--split") == 0 && i + 1 < argc) {
+            split_count = atoi(argv[++i]);
+            if (split_count < 1) {
+                usage(argv[0]);
+                return 1;
             }
+        } else if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cache_mib = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cache-stats") == 0) {
+            cache_stats = true;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats_mode = 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_mode = 2;
+        } else if (batch_mode && argv[i][0] != '-') {
+            // Everything from the first input on is a file or directory
+            first_input = i;
+            break;
+        } else if (!batch_mode && input_path == NULL) {
+            input_path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
         }
+    }
 
-        // Return statement
-        if (strstr(trimmed_line, "return ") == trimmed_line) {
-            char return_val[128];
-            sscanf(trimmed_line, "return %[^;];", return_val);
-            trim(return_val);
+    if ((batch_mode && first_input == argc) || (server_mode && (batch_mode || input_path != NULL)) ||
+        (socket_path != NULL && !server_mode) || (stream_mode && (batch_mode || server_mode)) ||
+        (run_mode && (batch_mode || server_mode || stream_mode || cache_dir != NULL || stats_mode != 0 ||
+                      options.profile)) ||
+        (split_count > 0 && (batch_mode || server_mode || stream_mode || run_mode || stats_mode != 0))) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (server_mode && cache_dir != NULL) {
+        // Items stored by a run are only written back when it ends
+        fprintf(stderr, "bminor2c: --cache cannot be used with --server\n");
+        return 1;
+    }
+    if (stream_mode && (cache_dir != NULL || options.optimize)) {
+        // Both look at the whole program before emitting anything
+        fprintf(stderr, "bminor2c: --stream cannot be used with %s\n", options.optimize ? "-O" : "--cache");
+        return 1;
+    }
+    if (split_count > 0 && options.profile) {
+        // The profiler's counters would be per file
+        fprintf(stderr, "bminor2c: --split cannot be used with --profile\n");
+        return 1;
+    }
+    if (server_mode) {
+        // A client that goes away only ends its own session
+        signal(SIGPIPE, SIG_IGN);
+        if (socket_path != NULL) return server_listen(socket_path, &options, stats_mode) ? 0 : 1;
+        return server_session(STDIN_FILENO, STDOUT_FILENO, &options, stats_mode) ? 0 : 1;
+    }
 
-            // Convert power operator in return value
-            convert_power(return_val);
-            
-            // If the return value contains pow(), cast it to int if the function returns integer
-            if (strstr(return_val, "pow(") != NULL) {
-                printf("return (int)%s;\n", return_val);
-            } else {
-                printf("return %s;\n", return_val);
-            }
-            continue;
+    Cache cache;
+    if (cache_dir != NULL) {
+        if (!cache_open(&cache, cache_dir, cache_mib << 20)) {
+            fprintf(stderr, "bminor2c: %s: %s\n", cache_dir, strerror(errno));
+            return 1;
         }
+        options.cache = &cache;
+    }
 
-        // Array declarations
-        if (strstr(trimmed_line, ": array") != NULL) {
-            char var_name[64];
-            char array_type[32];
-            char array_content[256];
-
-            if (strstr(trimmed_line, "= {") != NULL) { // Static array initialization
-                sscanf(trimmed_line, "%[^:]: array [%*d] %[^=]= %[^;];", var_name, array_type, array_content);
-                trim(var_name); trim(array_type); trim(array_content);
-                
-                if (strcmp(array_type, "integer") == 0) {
-                    printf("int %s[] = %s;\n", var_name, array_content);
-                } else {
-                    printf("// Unhandled static array type: %s\n", line);
-                }
-            } else if (strstr(trimmed_line, "= new array[") != NULL) { // Dynamic array allocation
-                int current_array_size;
-                sscanf(trimmed_line, "%[^:]: array [%*d] %[^=]= new array[%d];", var_name, array_type, &current_array_size);
-                trim(var_name); trim(array_type);
-                
-                // For local dynamic arrays, allocate here
-                if (in_function_body) {
-                    if (strcmp(array_type, "integer") == 0) {
-                        printf("int *%s = malloc(%d * sizeof(int));\n", var_name, current_array_size);
-                    } else if (strcmp(array_type, "boolean") == 0) {
-                        printf("bool *%s = malloc(%d * sizeof(bool));\n", var_name, current_array_size);
-                    } else {
-                        printf("// Unhandled local dynamic array type: %s\n", line);
-                    }
-                } else {
-                    // Global dynamic_array has specific handling in main. Others are not supported.
-                    printf("// Global dynamic array '%s' must be allocated in a function like main().\n", var_name);
-                }
-            } else {
-                printf("// Unhandled array declaration format: %s\n", line);
-            }
-            continue;
+    Stats stats = { 0 };
+    if (batch_mode) {
+        Batch batch = { 0 };
+        batch.output_dir = output_dir;
+        batch.options = &options;
+        if (stats_mode != 0) {
+            pthread_mutex_init(&batch.stats_lock, NULL);
+            batch.stats = &stats;
         }
+        bool ok = true;
+        for (int i = first_input; i < argc; i++) ok = batch_collect(&batch, argv[i], true) && ok;
+        if (thread_count <= 0) thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        // Nothing is written if two inputs share an output
+        if (batch_check_outputs(&batch)) batch_run(&batch, thread_count);
+        else ok = false;
 
-        // Variable declarations (global and local) - now after more specific cases
-        // Check for ':' and not array or function in the line.
-        if (strchr(trimmed_line, ':') != NULL && !strstr(trimmed_line, "array") && !strstr(trimmed_line, "function")) {
-            char var_name[64];
-            char var_type[32];
-            char var_value[128]; // Can be empty if no assignment
-
-            if (strchr(trimmed_line, '=') != NULL) { // Declaration with assignment
-                if (sscanf(trimmed_line, "%[^:]: %[^=]= %[^;];", var_name, var_type, var_value) == 3) {
-                    trim(var_name); trim(var_type); trim(var_value);
-
-                    // Convert power operator in value if present
-                    convert_power(var_value);
-
-                    // Type mapping
-                    if (strcmp(var_type, "integer") == 0) {
-                        // Cast to int if pow() is used, as pow returns double
-                        if (strstr(var_value, "pow(") != NULL) {
-                            printf("int %s = (int)%s;\n", var_name, var_value);
-                        } else {
-                            printf("int %s = %s;\n", var_name, var_value);
-                        }
-                    } else if (strcmp(var_type, "string") == 0) {
-                        printf("char* %s = %s;\n", var_name, var_value);
-                    } else if (strcmp(var_type, "boolean") == 0) {
-                        printf("bool %s = %s;\n", var_name, var_value);
-                    } else {
-                        printf("// Unhandled variable type: %s\n", line);
-                    }
-                    continue;
-                }
-            } else { // Declaration without assignment (e.g., i: integer;)
-                 if (sscanf(trimmed_line, "%[^:]: %[^;];", var_name, var_type) == 2) {
-                     trim(var_name); trim(var_type);
-                     if (strcmp(var_type, "integer") == 0) {
-                        printf("int %s;\n", var_name);
-                    } else if (strcmp(var_type, "string") == 0) {
-                        printf("char* %s;\n", var_name);
-                    } else if (strcmp(var_type, "boolean") == 0) {
-                        printf("bool %s;\n", var_name);
-                    } else {
-                        printf("// Unhandled variable type (no init): %s\n", line);
-                    }
-                    continue;
-                 }
-            }
+        if (memory_stats) {
+            fprintf(stderr, "bminor2c: %zu files, peak RSS: %ld KiB\n", batch.job_count, peak_rss_kib());
         }
+        if (stats_mode != 0) stats_print(&stats, stats_mode == 2);
+        int failures = atomic_load(&batch.failures);
+        if (!finish_cache(options.cache, cache_stats)) failures++;
+        for (size_t i = 0; i < batch.job_count; i++) {
+            free(batch.jobs[i].input_path);
+            free(batch.jobs[i].output_path);
+        }
+        free(batch.jobs);
+        return ok && failures == 0 ? 0 : 1;
+    }
 
-        // Array access and assignment (e.g., static_array[0] = temp;)
-        if (strchr(trimmed_line, '[') != NULL && strchr(trimmed_line, ']') != NULL && strchr(trimmed_line, '=') != NULL) {
-            char cleaned_line[256];
-            strcpy(cleaned_line, trimmed_line);
-            convert_power(cleaned_line); // Check for power in the assigned value
-            
-            // Cast to int if pow() is used in the assigned value
-            if (strstr(cleaned_line, "pow(") != NULL) {
-                char var_part[128];
-                char value_part[128];
-                // Assuming format like "array[index] = value;"
-                sscanf(cleaned_line, "%[^=]= %[^;];", var_part, value_part);
-                trim(var_part); trim(value_part);
-                printf("%s = (int)%s;\n", var_part, value_part);
-            } else {
-                printf("%s;\n", cleaned_line);
-            }
-            continue;
+    double mark = stats_mode != 0 ? now_seconds() : 0;
+    int input_fd = STDIN_FILENO;
+    if (input_path != NULL && strcmp(input_path, "-") != 0) {
+        input_fd = open(input_path, O_RDONLY);
+        if (input_fd < 0) {
+            perror(input_path);
+            return 1;
         }
+    }
 
-        // Simple assignments and expressions (must come after more specific patterns)
-        if (strchr(trimmed_line, '=') != NULL || strchr(trimmed_line, '+') != NULL || strchr(trimmed_line, '-') != NULL ||
-            strchr(trimmed_line, '*') != NULL || strchr(trimmed_line, '/') != NULL || strchr(trimmed_line, '%') != NULL) {
-            char cleaned_line[256];
-            strcpy(cleaned_line, trimmed_line);
-
-            // Convert power operator
-            convert_power(cleaned_line);
-
-            // Replace logical operators
-            char* ptr;
-            ptr = strstr(cleaned_line, " and ");
-            while (ptr) { memcpy(ptr, " && ", 4); ptr = strstr(ptr + 4, " and "); }
-            ptr = strstr(cleaned_line, " or ");
-            while (ptr) { memcpy(ptr, " || ", 4); ptr = strstr(ptr + 4, " or "); }
-            ptr = strstr(cleaned_line, " not ");
-            while (ptr) { memcpy(ptr, " ! ", 3); ptr = strstr(ptr + 3, " not "); }
-
-            // Cast to int if pow() is used in the assignment
-            if (strstr(cleaned_line, "pow(") != NULL) {
-                char var_part[128];
-                char value_part[128];
-                sscanf(cleaned_line, "%[^=]= %[^;];", var_part, value_part);
-                trim(var_part); trim(value_part);
-                printf("%s = (int)%s;\n", var_part, value_part);
-            } else {
-                printf("%s;\n", cleaned_line);
-            }
-            continue;
+    if (stream_mode) {
+        OutputBuffer output = { NULL, 0, 0, STDOUT_FILENO, 0, 0, false, 0, NULL, NULL };
+        OutputBuffer messages = { NULL, 0, 0, STDERR_FILENO, 0, 0, false, 0, NULL, NULL };
+        Diagnostics diagnostics = { NULL, &messages, 0 };
+        int status = 0;
+        if (!translate_stream(input_fd, &output, &diagnostics, &options, stats_mode != 0 ? &stats : NULL)) {
+            perror("bminor2c: read");
+            status = 1;
         }
-        
-        // Handle closing brace (already handled brace_level adjustment above)
-        if (strcmp(trimmed_line, "}") == 0) {
-            printf("}\n");
-            if (brace_level == 0 && in_function_body) { // Exiting the outermost function body (e.g., main)
-                in_function_body = false;
-                printf("    free(dynamic_array);\n"); // Free dynamic array at end of main
-            }
-            continue;
+        output_flush(&messages);
+        if (output.error != 0) {
+            fprintf(stderr, "bminor2c: write: %s\n", strerror(output.error));
+            status = 1;
         }
+        if (memory_stats) fprintf(stderr, "bminor2c: peak RSS: %ld KiB\n", peak_rss_kib());
+        if (stats_mode != 0) stats_print(&stats, stats_mode == 2);
+        if (input_fd != STDIN_FILENO) close(input_fd);
+        free(output.data);
+        free(messages.data);
+        return status;
+    }
 
-        // If a line reaches here, it's unhandled by specific rules
-        printf("// Unhandled Bminor statement: %s\n", line);
+    InputBuffer input;
+    if (!load_input(input_fd, &input)) {
+        perror("bminor2c: read");
+        return 1;
     }
+    if (input_fd != STDIN_FILENO) close(input_fd);
+    if (stats_mode != 0) stats_phase(&stats, PHASE_READ, &mark);
 
-    return 0;
-}
\ No newline at end of file
+    // The whole translation unit lives in one arena
+    Arena arena = { 0 };
+    OutputBuffer output = { NULL, 0, 0, STDOUT_FILENO, 0, 0, false, 0, NULL, NULL };
+    OutputBuffer messages = { NULL, 0, 0, STDERR_FILENO, 0, 0, false, 0, NULL, NULL };
+    Diagnostics diagnostics = { NULL, &messages, 0 };
+    int status = 0;
+    if (split_count > 0) {
+        // foo.bminor becomes foo.h and foo_1.c ... foo_N.c, next to it or in
+        // the -o directory; standard input becomes bminor.h and so on
+        Batch naming = { 0 };
+        naming.output_dir = output_dir;
+        char *base = batch_output_path(&naming, input_fd != STDIN_FILENO ? input_path : "bminor");
+        base[strlen(base) - 2] = '\0';
+        if (!translate_split(input.data, input.length, &diagnostics, &options, &arena, base, split_count)) status = 1;
+        free(base);
+    } else if (run_mode) {
+        status = run_program(input.data, input.length, &output, &diagnostics, &options, &arena);
+    } else {
+        translate(input.data, input.length, &output, &diagnostics, &options, &arena, stats_mode != 0 ? &stats : NULL);
+    }
+    output_flush(&messages);
+    if (output.error != 0) {
+        fprintf(stderr, "bminor2c: write: %s\n", strerror(output.error));
+        status = 1;
+    }
+
+    if (memory_stats) {
+        fprintf(stderr, "bminor2c: arena: %zu allocations in %zu blocks, %zu bytes used of %zu reserved\n",
+                arena.allocation_count, arena.block_count, arena.bytes_used, arena.bytes_reserved);
+        fprintf(stderr, "bminor2c: peak RSS: %ld KiB\n", peak_rss_kib());
+    }
+    if (stats_mode != 0) {
+        stats.input_bytes = input.length;
+        stats.arena_allocations = arena.allocation_count;
+        stats.arena_bytes = arena.bytes_used;
+        stats_print(&stats, stats_mode == 2);
+    }
+
+    if (!finish_cache(options.cache, cache_stats)) status = 1;
+    arena_free(&arena);
+    free(output.data);
+    free(messages.data);
+    release_input(&input);
+    return status;
+}
+#endif
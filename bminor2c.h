@@ -0,0 +1,58 @@
+// Library interface of bminor2c: translate Bminor source held in memory into
+// C from inside another program. Build bminor2c.c without its command line
+// and link it in:
+//
+//   gcc -O2 -DBMINOR2C_NO_MAIN -c bminor2c.c
+//   gcc -O2 service.c bminor2c.o -o service -lm -pthread
+//
+// A call keeps all of its state to itself, so any number of translations can
+// run at once on different threads.
+#ifndef BMINOR2C_H
+#define BMINOR2C_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What the generated C should look like; all false is the default
+typedef struct {
+    bool optimize;          // -O: constant folding and dead-branch elimination
+    bool buffered_output;   // --buffered-output: generated main gives stdout a 1 MiB buffer
+    bool parallel;          // --parallel: independent array loops become OpenMP parallel loops
+    bool profile;           // --profile: generated program reports time per function and loop
+} Bminor2cOptions;
+
+// Receives the generated C in order, in chunks of up to about 1 MiB.
+// Returning false discards the rest of the output.
+typedef bool (*Bminor2cSink)(void *context, const char *data, size_t length);
+
+typedef enum {
+    BMINOR2C_OK,            // Translated without errors
+    BMINOR2C_ERRORS,        // The program has errors; the C covers what could be translated
+    BMINOR2C_SINK_FAILED    // The sink returned false
+} Bminor2cStatus;
+
+// Messages about one translation, one "bminor2c: line N: ..." line each
+typedef struct {
+    char *text;             // Zero-terminated; NULL when there are none
+    size_t length;
+    int count;
+} Bminor2cDiagnostics;
+
+// Translate `length` bytes of Bminor source. source[length] must be a
+// readable zero byte, as at the end of a C string. `options` may be NULL for
+// the defaults, and `diagnostics` NULL to drop the messages.
+Bminor2cStatus bminor2c_translate(const char *source, size_t length, const Bminor2cOptions *options,
+                                  Bminor2cSink sink, void *context, Bminor2cDiagnostics *diagnostics);
+
+// Release the messages filled in by bminor2c_translate()
+void bminor2c_diagnostics_free(Bminor2cDiagnostics *diagnostics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif